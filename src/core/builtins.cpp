@@ -1,10 +1,15 @@
 #include "builtins.hpp"
 #include "interpreter.hpp"
-
-void ps::Builtins::CreateOperand(std::string_view name, std::function<void()> func)
-{
-	m_dict[std::string(name)] = std::make_shared<OperandObject>(func);
-}
+#include "nametable.hpp"
+#include "objects/array.hpp"
+#include "objects/string.hpp"
+#include "perfecthash.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
 
 struct abs {
 	template <typename T>
@@ -14,114 +19,1148 @@ struct abs {
 	}
 };
 
+namespace
+{
+using namespace ps::operand;
+using ps::Builtins;
+using ps::Error;
+using ps::ObjectAccess;
+using ps::Opcode;
+using ps::ObjectType;
+using ps::TypeBit;
+using ps::util;
+using ps::Value;
+
+// Operations for Builtins::Arithmetic. Integer results that overflow are
+// computed in double and become reals.
+struct AddOp
+{
+	static bool Integers(int a, int b, Value& result)
+	{
+		int sum;
+		result = util::AddOverflow(a, b, sum) ? Value(static_cast<float>(double(a) + b)) : Value(sum);
+		return true;
+	}
+
+	static float Reals(float a, float b)
+	{
+		return a + b;
+	}
+};
+
+struct SubOp
+{
+	static bool Integers(int a, int b, Value& result)
+	{
+		int difference;
+		result = util::SubOverflow(a, b, difference) ? Value(static_cast<float>(double(a) - b)) : Value(difference);
+		return true;
+	}
+
+	static float Reals(float a, float b)
+	{
+		return a - b;
+	}
+};
 
-std::map<std::string, std::shared_ptr<ps::Object>>& ps::Builtins::CreateDictionary(Interpreter* interpr)
+struct MulOp
 {
-	m_interpr = interpr;
+	static bool Integers(int a, int b, Value& result)
+	{
+		int product;
+		result = util::MulOverflow(a, b, product) ? Value(static_cast<float>(double(a) * b)) : Value(product);
+		return true;
+	}
 
+	static float Reals(float a, float b)
+	{
+		return a * b;
+	}
+};
+
+// The quotient is always real
+struct DivOp
+{
+	static bool Integers(int a, int b, Value& result)
+	{
+		if (b == 0)
+			return false;
+		result = Value(static_cast<float>(double(a) / b));
+		return true;
+	}
+
+	static float Reals(float a, float b)
+	{
+		return a / b;
+	}
+};
+
+// Loops keep their state on the execution stack, below a continuation that
+// runs after each iteration: proc (loop), count proc (repeat), current
+// increment limit proc (for) and container index proc (forall). Returns the
+// number of state values, 0 for anything that isn't a loop continuation.
+constexpr size_t GetLoopFrameSize(Opcode opcode)
+{
+	switch (opcode)
+	{
+	case Opcode::LoopContinue:
+		return 1;
+	case Opcode::RepeatContinue:
+		return 2;
+	case Opcode::ForAllContinue:
+		return 3;
+	case Opcode::ForContinue:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+// Whether the execution stack holds the frame of `continuation`'s loop.
+// Continuations are internal, but execstack and error handlers can hand
+// them out, so they check before touching the frame.
+bool HasLoopFrame(Builtins& b, Opcode continuation)
+{
+	// The loop reserved room for one more iteration
+	auto& exec = b.GetExecStack();
+	if (exec.Size() < GetLoopFrameSize(continuation) || exec.GetFree() < 2)
+		return false;
+
+	auto type = [&](size_t i) { return exec.Top(i).GetType(); };
+	if (type(0) != ObjectType::Array)
+		return false;
+	switch (continuation)
+	{
+	case Opcode::RepeatContinue:
+		return type(1) == ObjectType::Integer;
+	case Opcode::ForAllContinue:
+		return (type(2) == ObjectType::Array || type(2) == ObjectType::String || type(2) == ObjectType::Dict) &&
+			   type(1) == ObjectType::Integer;
+	case Opcode::ForContinue:
+		// for converts all three numbers to the same type
+		return (type(3) == ObjectType::Integer || type(3) == ObjectType::Real) && type(2) == type(3) &&
+			   type(1) == type(3);
+	default:
+		return true;
+	}
+}
+
+// Starts a loop taking `operands` operands, the continuation runs first and
+// decides whether the body runs at all. Two more slots are reserved for the
+// continuation and the body of each iteration, so iterating never fails.
+bool BeginLoop(Builtins& b, Opcode continuation, size_t operands, std::initializer_list<Value> frame)
+{
+	if (!b.ReserveExec(frame.size() + 2))
+		return false;
+
+	auto& exec = b.GetExecStack();
+	for (auto& value : frame)
+		exec.Push(value);
+	exec.Push(Value::Operator(continuation));
+	b.GetStack().Pop(operands);
+	return true;
+}
+
+// Runs the body once more and the continuation after it, nothing is
+// allocated per iteration
+void Iterate(Builtins& b, Opcode continuation)
+{
+	auto& exec = b.GetExecStack();
+	auto proc = exec.Top();
+	exec.Push(Value::Operator(continuation));
+	exec.Push(proc);
+}
+
+// All builtin operators with their signatures. Operand counts and types
+// listed here are checked by the interpreter before the call.
+constexpr ps::OperatorInfo s_operators[] = {
 	//STACK
 	//POP
-	CreateOperand("pop", [this]() {
-		Pop();
-		});
+	{Opcode::Pop, "pop", {Any}, [](Builtins& b) {
+		b.Pop();
+		}},
 
 	//EXCH
-	CreateOperand("exch", [this]() {
-		auto first = Pop();
-		auto second = Pop();
-		Push(first);
-		Push(second);
-		});
+	{Opcode::Exch, "exch", {Any, Any}, [](Builtins& b) {
+		std::swap(b.Top(0), b.Top(1));
+		}},
 
 	//DUP
-	CreateOperand("dup", [this]() {
-		Push(Top());
-		});
+	{Opcode::Dup, "dup", {Any}, [](Builtins& b) {
+		if (b.Reserve(1))
+			b.GetStack().Copy(1);
+		}},
 
 	//COPY
-	CreateOperand("copy", [&]() {
-		int n = Pop<int>();
-		auto vec = Pop(n);
-		std::reverse(vec.begin(), vec.end());
-		Push(vec);
-		Push(vec);
-		});
-
-	// //index
-	// dict["index"] = std::make_shared<OperandObject>([&]() {
-	//   int n = popInt();
-	//   auto vec = std::vector<std::shared_ptr<ps::Object>>();
-	//   for (int i = 0; i < n + 1; i++)
-	//   	vec.push_back(pop());
-	//   for (int i = n; i >= 0; i--)
-	//   	s.push(vec[i]);
-	//   s.push(vec[n]);
-	// });
-
-	//clear
-	CreateOperand("clear", [this]() {
-		auto s = GetStack();
-		while (!s.empty())
-			s.pop();
-		});
-
-	//count
-	CreateOperand("count", [this]() {
-		Push<int>(GetStack().size());
-		});
+	{Opcode::Copy, "copy", {Integer}, [](Builtins& b) {
+		int n = b.Top().GetInteger();
+		if (n < 0)
+			return (void)b.Raise(Error::RangeCheck);
+		if (!b.Require(static_cast<size_t>(n) + 1) || (n > 0 && !b.Reserve(n - 1)))
+			return;
+		b.Pop();
+		b.GetStack().Copy(n);
+		}},
+
+	//INDEX
+	{Opcode::Index, "index", {Integer}, [](Builtins& b) {
+		int n = b.Top().GetInteger();
+		if (n < 0)
+			return (void)b.Raise(Error::RangeCheck);
+		if (!b.Require(static_cast<size_t>(n) + 2))
+			return;
+		b.Top() = b.Top(n + 1);
+		}},
+
+	//ROLL
+	{Opcode::Roll, "roll", {Integer, Integer}, [](Builtins& b) {
+		int n = b.Top(1).GetInteger();
+		int j = b.Top(0).GetInteger();
+		if (n < 0)
+			return (void)b.Raise(Error::RangeCheck);
+		if (!b.Require(static_cast<size_t>(n) + 2))
+			return;
+		b.GetStack().Pop(2);
+		if (n > 0)
+			b.GetStack().Roll(n, ((j % n) + n) % n);
+		}},
+
+	//CLEAR
+	{Opcode::Clear, "clear", {}, [](Builtins& b) {
+		b.GetStack().Clear();
+		}},
+
+	//COUNT
+	{Opcode::Count, "count", {}, [](Builtins& b) {
+		if (b.Reserve(1))
+			b.Push<int>(b.GetStack().Size());
+		}},
+
+	//MARK
+	{Opcode::Mark, "mark", {}, [](Builtins& b) {
+		if (b.Reserve(1))
+			b.Push(Value(ObjectType::Mark));
+		}},
+
+	//CLEARTOMARK
+	{Opcode::ClearToMark, "cleartomark", {}, [](Builtins& b) {
+		auto& s = b.GetStack();
+		for (size_t i = 0; i < s.Size(); ++i)
+		{
+			if (s.Top(i).GetType() == ObjectType::Mark)
+				return s.Pop(i + 1);
+		}
+		b.Raise(Error::UnmatchedMark);
+		}},
+
+	//COUNTTOMARK
+	{Opcode::CountToMark, "counttomark", {}, [](Builtins& b) {
+		auto& s = b.GetStack();
+		for (size_t i = 0; i < s.Size(); ++i)
+		{
+			if (s.Top(i).GetType() == ObjectType::Mark)
+			{
+				if (b.Reserve(1))
+					b.Push<int>(i);
+				return;
+			}
+		}
+		b.Raise(Error::UnmatchedMark);
+		}},
 
 	//ARITHMETIC
 	//ADD
-	CreateOperand("add", [this]() {
-		BinaryOp(std::plus<>{});
-		});
+	{Opcode::Add, "add", {Number, Number}, [](Builtins& b) {
+		b.Arithmetic<AddOp>();
+		}},
 
 	//DIV
-	CreateOperand("div", [this]() {
-		BinaryOp(std::divides<>{});
-		});
+	{Opcode::Div, "div", {Number, Number}, [](Builtins& b) {
+		b.Arithmetic<DivOp>();
+		}},
 
 	//IDIV
-	CreateOperand("idiv", [this]() {
-		BinaryOp(std::divides<int>{});
-		});
+	{Opcode::IDiv, "idiv", {Integer, Integer}, [](Builtins& b) {
+		int a = b.Top(1).GetInteger();
+		int d = b.Top(0).GetInteger();
+		// the one quotient that doesn't fit an integer
+		if (d == 0 || (d == -1 && a == std::numeric_limits<int>::min()))
+		{
+			b.Raise(Error::UndefinedResult);
+			return;
+		}
+		b.GetStack().Pop(1);
+		b.Top() = Value(a / d);
+		}},
 
 	//MOD
-	CreateOperand("mod", [this]() {
-		BinaryOp(std::modulus<>{});
-		});
+	{Opcode::Mod, "mod", {Integer, Integer}, [](Builtins& b) {
+		int a = b.Top(1).GetInteger();
+		int d = b.Top(0).GetInteger();
+		if (d == 0)
+		{
+			b.Raise(Error::UndefinedResult);
+			return;
+		}
+		b.GetStack().Pop(1);
+		b.Top() = Value(d == -1 ? 0 : a % d);
+		}},
 
 	//MUL
-	CreateOperand("mul", [this]() {
-		BinaryOp(std::multiplies<>{});
-		});
+	{Opcode::Mul, "mul", {Number, Number}, [](Builtins& b) {
+		b.Arithmetic<MulOp>();
+		}},
 
 	//SUB
-	CreateOperand("sub", [this]() {
-		BinaryOp(std::minus<>{});
-		});
+	{Opcode::Sub, "sub", {Number, Number}, [](Builtins& b) {
+		b.Arithmetic<SubOp>();
+		}},
 
 	//ABS
-	//CreateOperand("abs", [this]() {
-	//	UnaryOp(Builtins::abs<>{});
-	//	});
+	//{"abs", {Number}, [](Builtins& b) {
+	//	b.UnaryOp(Builtins::abs<>{});
+	//	}},
 
 	//NEG
-	CreateOperand("neg", [this]() {
-		UnaryOp(std::negate<>{});
-		});
+	{Opcode::Neg, "neg", {Number}, [](Builtins& b) {
+		auto& a = b.Top();
+		if (a.GetType() == ObjectType::Integer && a.GetInteger() == std::numeric_limits<int>::min())
+			a = Value(-static_cast<float>(a.GetInteger()));
+		else
+			b.UnaryOp(std::negate<>{});
+		}},
+
+	//DICTIONARIES
+	//DICT
+	{Opcode::Dict, "dict", {Integer}, [](Builtins& b) {
+		int n = b.Top().GetInteger();
+		if (n < 0)
+			return (void)b.Raise(Error::RangeCheck);
+		if (static_cast<uint32_t>(n) > ps::DictObject::MaxCapacity)
+			return (void)b.Raise(Error::LimitCheck);
+		b.Top() = Value(ps::DictObject::Create(b.GetVM(), n));
+		}},
+
+	//LENGTH
+	{Opcode::Length, "length", {Dict | String | Array | TypeBit(ObjectType::Name)}, [](Builtins& b) {
+		auto& obj = b.Top();
+		if (obj.GetType() == ObjectType::Dict)
+			obj = Value(static_cast<int>(obj.GetObject<ps::DictObject>()->GetLength()));
+		else if (obj.GetType() == ObjectType::String || obj.GetType() == ObjectType::Array)
+			obj = Value(static_cast<int>(obj.GetLength()));
+		else
+			obj = Value(static_cast<int>(ps::NameTable::GetName(obj.GetAtom()).size()));
+		}},
+
+	//MAXLENGTH
+	{Opcode::MaxLength, "maxlength", {Dict}, [](Builtins& b) {
+		b.Top() = Value(static_cast<int>(b.Top().GetObject<ps::DictObject>()->GetMaxLength()));
+		}},
+
+	//BEGIN
+	{Opcode::Begin, "begin", {Dict}, [](Builtins& b) {
+		if (b.GetInterpreter().BeginDict(b.Top()))
+			b.Pop();
+		}},
+
+	//END
+	{Opcode::End, "end", {}, [](Builtins& b) {
+		b.GetInterpreter().EndDict();
+		}},
+
+	//DEF
+	{Opcode::Def, "def", {Any, Any}, [](Builtins& b) {
+		auto* dict = b.GetDictStack().Top().GetObject<ps::DictObject>();
+		b.GetInterpreter().Define(dict, b.ToKey(b.Top(1)), b.Top());
+		if (b.GetInterpreter().GetError() == Error::None)
+			b.GetStack().Pop(2);
+		}},
+
+	//LOAD
+	{Opcode::Load, "load", {Any}, [](Builtins& b) {
+		auto key = b.ToKey(b.Top());
+		auto& dicts = b.GetDictStack();
+		for (size_t i = 0; i < dicts.Size(); ++i)
+		{
+			if (auto* value = dicts.Top(i).GetObject<ps::DictObject>()->Find(key))
+			{
+				b.Top() = *value;
+				return;
+			}
+		}
+		b.Raise(Error::Undefined);
+		}},
+
+	//KNOWN
+	{Opcode::Known, "known", {Dict, Any}, [](Builtins& b) {
+		auto key = b.ToKey(b.Pop());
+		auto* dict = b.Top().GetObject<ps::DictObject>();
+		b.Top() = Value(dict->Find(key) != nullptr);
+		}},
+
+	//WHERE
+	{Opcode::Where, "where", {Any}, [](Builtins& b) {
+		if (!b.Reserve(1))
+			return;
+		auto key = b.ToKey(b.Pop());
+		auto& dicts = b.GetDictStack();
+		for (size_t i = 0; i < dicts.Size(); ++i)
+		{
+			if (dicts.Top(i).GetObject<ps::DictObject>()->Find(key))
+			{
+				b.Push(dicts.Top(i));
+				b.Push<bool>(true);
+				return;
+			}
+		}
+		b.Push<bool>(false);
+		}},
+
+	//UNDEF
+	{Opcode::Undef, "undef", {Dict, Any}, [](Builtins& b) {
+		b.GetInterpreter().Undefine(b.Top(1).GetObject<ps::DictObject>(), b.ToKey(b.Top()));
+		if (b.GetInterpreter().GetError() == Error::None)
+			b.GetStack().Pop(2);
+		}},
+
+	//CURRENTDICT
+	{Opcode::CurrentDict, "currentdict", {}, [](Builtins& b) {
+		if (b.Reserve(1))
+			b.Push(b.GetDictStack().Top());
+		}},
+
+	//COUNTDICTSTACK
+	{Opcode::CountDictStack, "countdictstack", {}, [](Builtins& b) {
+		if (b.Reserve(1))
+			b.Push<int>(b.GetDictStack().Size());
+		}},
+
+	//VM
+	//SAVE
+	{Opcode::Save, "save", {}, [](Builtins& b) {
+		if (!b.Reserve(1))
+			return;
+		auto& vm = b.GetVM();
+		auto id = vm.Save();
+		b.Push(Value::Save(vm.GetLevel(), id));
+		}},
+
+	//RESTORE
+	{Opcode::Restore, "restore", {Save}, [](Builtins& b) {
+		auto save = b.Pop();
+		if (!b.GetInterpreter().Restore(save))
+			b.Push(save);
+		}},
+
+	//STRINGS
+	//STRING
+	{Opcode::String, "string", {Integer}, [](Builtins& b) {
+		int n = b.Top().GetInteger();
+		if (n < 0 || n > 65535)
+			return (void)b.Raise(Error::RangeCheck);
+		b.Top() = Value::String(ps::StringObject::Create(b.GetVM(), n), 0, n);
+		}},
+
+	//GET
+	{Opcode::Get, "get", {String | Dict | Array, Any}, [](Builtins& b) {
+		auto& container = b.Top(1);
+		if (container.GetType() == ObjectType::Dict)
+		{
+			auto* value = container.GetObject<ps::DictObject>()->Find(b.ToKey(b.Top()));
+			if (!value)
+				return (void)b.Raise(Error::Undefined);
+			b.Pop();
+			b.Top() = *value;
+			return;
+		}
+
+		if (b.Top().GetType() != ObjectType::Integer)
+			return (void)b.Raise(Error::TypeCheck);
+		int index = b.Top().GetInteger();
+		if (index < 0 || index >= static_cast<int>(container.GetLength()))
+			return (void)b.Raise(Error::RangeCheck);
+		if (container.GetType() == ObjectType::Array)
+		{
+			auto element = b.GetArray(container)[index];
+			b.Pop();
+			b.Top() = element;
+			return;
+		}
+		int c = static_cast<uint8_t>(b.GetString(container)[index]);
+		b.Pop();
+		b.Top() = Value(c);
+		}},
+
+	//PUT
+	{Opcode::Put, "put", {String | Dict | Array, Any, Any}, [](Builtins& b) {
+		auto& container = b.Top(2);
+		if (container.GetType() == ObjectType::Dict)
+		{
+			auto* dict = container.GetObject<ps::DictObject>();
+			b.GetInterpreter().Define(dict, b.ToKey(b.Top(1)), b.Top());
+			if (b.GetInterpreter().GetError() == Error::None)
+				b.GetStack().Pop(3);
+			return;
+		}
+
+		if (container.GetType() == ObjectType::Array)
+		{
+			if (b.Top(1).GetType() != ObjectType::Integer)
+				return (void)b.Raise(Error::TypeCheck);
+			int index = b.Top(1).GetInteger();
+			if (index < 0 || index >= static_cast<int>(container.GetLength()))
+				return (void)b.Raise(Error::RangeCheck);
+			if (auto* element = b.GetWritableArray(container, index, 1))
+			{
+				*element = b.Top();
+				b.GetStack().Pop(3);
+			}
+			return;
+		}
+
+		if (b.Top(1).GetType() != ObjectType::Integer || b.Top().GetType() != ObjectType::Integer)
+			return (void)b.Raise(Error::TypeCheck);
+		int index = b.Top(1).GetInteger();
+		int c = b.Top().GetInteger();
+		if (index < 0 || index >= static_cast<int>(container.GetLength()) || c < 0 || c > 255)
+			return (void)b.Raise(Error::RangeCheck);
+		if (auto* data = b.GetWritableString(container, index, 1))
+		{
+			*data = static_cast<char>(c);
+			b.GetStack().Pop(3);
+		}
+		}},
+
+	//GETINTERVAL
+	{Opcode::GetInterval, "getinterval", {String | Array, Integer, Integer}, [](Builtins& b) {
+		int index = b.Top(1).GetInteger();
+		int count = b.Top().GetInteger();
+		auto& str = b.Top(2);
+		if (index < 0 || count < 0 || index + count > static_cast<int>(str.GetLength()))
+			return (void)b.Raise(Error::RangeCheck);
+		// The interval shares the storage of the original string or array
+		auto interval = str.GetInterval(index, count);
+		b.GetStack().Pop(2);
+		b.Top() = interval;
+		}},
+
+	//PUTINTERVAL
+	{Opcode::PutInterval, "putinterval", {String | Array, Integer, String | Array}, [](Builtins& b) {
+		int index = b.Top(1).GetInteger();
+		if (b.Top(2).GetType() != b.Top().GetType())
+			return (void)b.Raise(Error::TypeCheck);
+		if (b.Top().GetType() == ObjectType::Array)
+		{
+			auto& source = b.Top();
+			auto& target = b.Top(2);
+			if (index < 0 || index + source.GetLength() > target.GetLength())
+				return (void)b.Raise(Error::RangeCheck);
+			if (auto* elements = b.GetWritableArray(target, index, source.GetLength()))
+			{
+				std::memmove(elements, b.GetArray(source), source.GetLength() * sizeof(Value));
+				b.GetStack().Pop(3);
+			}
+			return;
+		}
+
+		auto source = b.GetString(b.Top());
+		auto& target = b.Top(2);
+		if (index < 0 || index + source.size() > target.GetLength())
+			return (void)b.Raise(Error::RangeCheck);
+		if (auto* data = b.GetWritableString(target, index, source.size()))
+		{
+			// Source and target may share storage
+			std::memmove(data, source.data(), source.size());
+			b.GetStack().Pop(3);
+		}
+		}},
+
+	//ANCHORSEARCH
+	{Opcode::AnchorSearch, "anchorsearch", {String, String}, [](Builtins& b) {
+		auto str = b.Top(1);
+		auto seek = b.GetString(b.Top());
+		if (b.GetString(str).substr(0, seek.size()) != seek)
+		{
+			b.Top() = Value(false);
+			b.Top(1) = str;
+			return;
+		}
+		if (!b.Reserve(1))
+			return;
+		b.Top(1) = Value::String(str.GetObject<ps::Object>(), str.GetOffset() + seek.size(), str.GetLength() - seek.size());
+		b.Top() = Value::String(str.GetObject<ps::Object>(), str.GetOffset(), seek.size());
+		b.Push<bool>(true);
+		}},
+
+	//SEARCH
+	{Opcode::Search, "search", {String, String}, [](Builtins& b) {
+		auto str = b.Top(1);
+		auto seek = b.GetString(b.Top());
+		auto pos = b.GetString(str).find(seek);
+		if (pos == std::string_view::npos)
+		{
+			b.Top() = Value(false);
+			return;
+		}
+		if (!b.Reserve(2))
+			return;
+		// post, match and pre all share the storage of the searched string
+		auto* storage = str.GetObject<ps::Object>();
+		uint32_t offset = str.GetOffset();
+		uint32_t end = static_cast<uint32_t>(pos + seek.size());
+		b.Top(1) = Value::String(storage, offset + end, str.GetLength() - end);
+		b.Top() = Value::String(storage, offset + pos, seek.size());
+		b.Push(Value::String(storage, offset, pos));
+		b.Push<bool>(true);
+		}},
+
+	//ARRAYS
+	//ARRAY
+	{Opcode::Array, "array", {Integer}, [](Builtins& b) {
+		int n = b.Top().GetInteger();
+		if (n < 0 || n > 65535)
+			return (void)b.Raise(Error::RangeCheck);
+		b.Top() = Value::Array(ps::ArrayObject::Create(b.GetVM(), n), 0, n);
+		}},
+
+	//[
+	{Opcode::ArrayBegin, "[", {}, [](Builtins& b) {
+		if (b.Reserve(1))
+			b.Push(Value(ObjectType::Mark));
+		}},
+
+	//]
+	{Opcode::ArrayEnd, "]", {}, [](Builtins& b) {
+		auto& s = b.GetStack();
+		size_t n = 0;
+		while (n < s.Size() && s.Top(n).GetType() != ObjectType::Mark)
+			++n;
+		if (n == s.Size())
+			return (void)b.Raise(Error::UnmatchedMark);
+		if (n > 65535)
+			return (void)b.Raise(Error::RangeCheck);
+		auto* array = ps::ArrayObject::Create(b.GetVM(), n);
+		std::copy(s.end() - n, s.end(), array->GetData());
+		s.Pop(n);
+		s.Top() = Value::Array(array, 0, n);
+		}},
+
+	//ALOAD
+	{Opcode::ALoad, "aload", {Array}, [](Builtins& b) {
+		if (!b.Reserve(b.Top().GetLength()))
+			return;
+		auto array = b.Pop();
+		auto* elements = b.GetArray(array);
+		for (uint32_t i = 0; i < array.GetLength(); ++i)
+			b.Push(elements[i]);
+		b.Push(array);
+		}},
+
+	//ASTORE
+	{Opcode::AStore, "astore", {Array}, [](Builtins& b) {
+		auto array = b.Top();
+		uint32_t n = array.GetLength();
+		if (!b.Require(n + 1))
+			return;
+		if (auto* elements = b.GetWritableArray(array, 0, n))
+		{
+			auto& s = b.GetStack();
+			std::copy(s.end() - n - 1, s.end() - 1, elements);
+			s.Pop(n);
+			s.Top() = array;
+		}
+		}},
+
+	//CONTROL
+	//EXEC
+	{Opcode::Exec, "exec", {Any}, [](Builtins& b) {
+		// Literals are their own result
+		if (b.Top().IsExecutable() && b.GetInterpreter().PushExec(b.Top()))
+			b.Pop();
+		}},
+
+	//EXECSTACK
+	{Opcode::ExecStack, "execstack", {Array}, [](Builtins& b) {
+		auto& exec = b.GetExecStack();
+		auto array = b.Top();
+		if (array.GetLength() < exec.Size())
+			return (void)b.Raise(Error::RangeCheck);
+		if (auto* elements = b.GetWritableArray(array, 0, exec.Size()))
+		{
+			// Files only live while they're being read, like in $error
+			std::transform(exec.begin(), exec.end(), elements, [](const Value& entry) {
+				return entry.GetType() == ObjectType::File ? Value(ObjectType::Null) : entry;
+			});
+			b.Top() = array.GetInterval(0, exec.Size());
+		}
+		}},
+
+	//COUNTEXECSTACK
+	{Opcode::CountExecStack, "countexecstack", {}, [](Builtins& b) {
+		if (b.Reserve(1))
+			b.Push<int>(b.GetExecStack().Size());
+		}},
+
+	//IF
+	{Opcode::If, "if", {Boolean, Proc}, [](Builtins& b) {
+		if (!b.Top(1).GetBoolean())
+			return b.GetStack().Pop(2);
+		if (b.GetInterpreter().PushExec(b.Top()))
+			b.GetStack().Pop(2);
+		}},
+
+	//IFELSE
+	{Opcode::IfElse, "ifelse", {Boolean, Proc, Proc}, [](Builtins& b) {
+		auto& proc = b.Top(2).GetBoolean() ? b.Top(1) : b.Top(0);
+		if (b.GetInterpreter().PushExec(proc))
+			b.GetStack().Pop(3);
+		}},
+
+	//FOR
+	{Opcode::For, "for", {Number, Number, Number, Proc}, [](Builtins& b) {
+		Value initial = b.Top(3);
+		Value increment = b.Top(2);
+		Value limit = b.Top(1);
+		// The control variable is an integer only if all operands are
+		if (initial.GetType() != ObjectType::Integer || increment.GetType() != ObjectType::Integer)
+		{
+			auto toReal = [](const Value& v) {
+				return v.GetType() == ObjectType::Integer ? Value(static_cast<float>(v.GetInteger())) : v;
+			};
+			initial = toReal(initial);
+			increment = toReal(increment);
+			limit = toReal(limit);
+		}
+		else if (limit.GetType() == ObjectType::Real)
+		{
+			// the loop runs while the integer is within the real limit
+			double real = limit.GetReal();
+			real = increment.GetInteger() >= 0 ? std::floor(real) : std::ceil(real);
+			real = std::clamp(real, static_cast<double>(std::numeric_limits<int>::min()),
+							  static_cast<double>(std::numeric_limits<int>::max()));
+			limit = Value(static_cast<int>(real));
+		}
+		BeginLoop(b, Opcode::ForContinue, 4, {initial, increment, limit, b.Top()});
+		}},
+
+	//REPEAT
+	{Opcode::Repeat, "repeat", {Integer, Proc}, [](Builtins& b) {
+		if (b.Top(1).GetInteger() < 0)
+			return (void)b.Raise(Error::RangeCheck);
+		BeginLoop(b, Opcode::RepeatContinue, 2, {b.Top(1), b.Top()});
+		}},
+
+	//LOOP
+	{Opcode::Loop, "loop", {Proc}, [](Builtins& b) {
+		BeginLoop(b, Opcode::LoopContinue, 1, {b.Top()});
+		}},
+
+	//FORALL
+	{Opcode::ForAll, "forall", {Array | String | Dict, Proc}, [](Builtins& b) {
+		BeginLoop(b, Opcode::ForAllContinue, 2, {b.Top(1), Value(0), b.Top()});
+		}},
+
+	//EXIT
+	{Opcode::Exit, "exit", {}, [](Builtins& b) {
+		// Unwinds to the innermost loop, but never out of a file
+		auto& exec = b.GetExecStack();
+		for (size_t i = 0; i < exec.Size(); ++i)
+		{
+			auto& entry = exec.Top(i);
+			if (entry.GetType() == ObjectType::File)
+				break;
+			if (entry.GetType() != ObjectType::Operand)
+				continue;
+			// nor out of a stopped context
+			if (entry.GetOpcode() == Opcode::StoppedContinue)
+				break;
+			if (auto frame = GetLoopFrameSize(entry.GetOpcode()))
+				return exec.Pop(i + 1 + frame);
+		}
+		b.Raise(Error::InvalidExit);
+		}},
+
+	//STOP
+	{Opcode::Stop, "stop", {}, [](Builtins& b) {
+		b.GetInterpreter().Stop();
+		}},
+
+	//STOPPED
+	{Opcode::Stopped, "stopped", {Any}, [](Builtins& b) {
+		// Like exec, with a continuation that pushes false when the object
+		// completes. stop unwinds to the continuation and pushes true.
+		if (!b.ReserveExec(2))
+			return;
+		b.GetExecStack().Push(Value::Operator(Opcode::StoppedContinue));
+		if (b.Top().IsExecutable())
+			b.GetExecStack().Push(b.Pop());
+		}},
+
+	//BIND
+	{Opcode::Bind, "bind", {Proc}, [](Builtins& b) {
+		// Nested procedures are walked with an explicit work list, read-only
+		// ones are already bound and left alone
+		if (b.Top().GetAccess() != ObjectAccess::Unlimited)
+			return;
+		auto& interpr = b.GetInterpreter();
+		std::vector<Value> pending = {b.Top()};
+		while (!pending.empty())
+		{
+			auto proc = pending.back();
+			pending.pop_back();
+			proc.GetObject<ps::ArrayObject>()->Invalidate(b.GetVM());
+			auto* elements = b.GetArray(proc);
+			for (uint32_t i = 0; i < proc.GetLength(); ++i)
+			{
+				auto& element = elements[i];
+				if (element.GetType() == ObjectType::Name && element.IsExecutable())
+				{
+					auto* value = interpr.DictLookup(element);
+					if (value && value->GetType() == ObjectType::Operand)
+					{
+						b.GetVM().Journal(proc.GetObject<ps::Object>(), &element, sizeof(Value));
+						element = *value;
+					}
+				}
+				else if (element.GetType() == ObjectType::Array && element.IsExecutable() &&
+						 element.GetAccess() == ObjectAccess::Unlimited)
+				{
+					b.GetVM().Journal(proc.GetObject<ps::Object>(), &element, sizeof(Value));
+					element.SetAccess(ObjectAccess::ReadOnly);
+					pending.push_back(element);
+				}
+			}
+		}
+		}},
+
+	//ATTRIBUTES
+	//CVX
+	{Opcode::Cvx, "cvx", {Any}, [](Builtins& b) {
+		b.Top().SetExecutable(true);
+		}},
+
+	//CVLIT
+	{Opcode::Cvlit, "cvlit", {Any}, [](Builtins& b) {
+		b.Top().SetExecutable(false);
+		}},
+
+	//XCHECK
+	{Opcode::XCheck, "xcheck", {Any}, [](Builtins& b) {
+		b.Top() = Value(b.Top().IsExecutable());
+		}},
+
+	//CONTINUATIONS
+	//%FOR_CONTINUE
+	{Opcode::ForContinue, "%for_continue", {}, [](Builtins& b) {
+		if (!HasLoopFrame(b, Opcode::ForContinue))
+			return (void)b.Raise(Error::Unregistered);
+		auto& exec = b.GetExecStack();
+		auto& current = exec.Top(3);
+		auto& increment = exec.Top(2);
+		auto& limit = exec.Top(1);
+
+		if (current.GetType() == ObjectType::Integer)
+		{
+			int c = current.GetInteger();
+			int i = increment.GetInteger();
+			if (i >= 0 ? c > limit.GetInteger() : c < limit.GetInteger())
+				return exec.Pop(4);
+			if (!b.Reserve(1))
+				return;
+			b.Push(current);
+
+			int next;
+			if (util::AddOverflow(c, i, next))
+			{
+				// Past the limit, this is the last iteration
+				auto proc = exec.Top();
+				exec.Pop(4);
+				exec.Push(proc);
+				return;
+			}
+			current = Value(next);
+		}
+		else
+		{
+			float c = current.GetReal();
+			float i = increment.GetReal();
+			if (i >= 0 ? c > limit.GetReal() : c < limit.GetReal())
+				return exec.Pop(4);
+			if (!b.Reserve(1))
+				return;
+			b.Push(current);
+			current = Value(c + i);
+		}
+		Iterate(b, Opcode::ForContinue);
+		}},
+
+	//%REPEAT_CONTINUE
+	{Opcode::RepeatContinue, "%repeat_continue", {}, [](Builtins& b) {
+		if (!HasLoopFrame(b, Opcode::RepeatContinue))
+			return (void)b.Raise(Error::Unregistered);
+		auto& exec = b.GetExecStack();
+		auto& count = exec.Top(1);
+		if (count.GetInteger() <= 0)
+			return exec.Pop(2);
+		count = Value(count.GetInteger() - 1);
+		Iterate(b, Opcode::RepeatContinue);
+		}},
+
+	//%LOOP_CONTINUE
+	{Opcode::LoopContinue, "%loop_continue", {}, [](Builtins& b) {
+		if (!HasLoopFrame(b, Opcode::LoopContinue))
+			return (void)b.Raise(Error::Unregistered);
+		Iterate(b, Opcode::LoopContinue);
+		}},
+
+	//%FORALL_CONTINUE
+	{Opcode::ForAllContinue, "%forall_continue", {}, [](Builtins& b) {
+		if (!HasLoopFrame(b, Opcode::ForAllContinue))
+			return (void)b.Raise(Error::Unregistered);
+		auto& exec = b.GetExecStack();
+		auto& container = exec.Top(2);
+		auto& index = exec.Top(1);
+		uint32_t i = static_cast<uint32_t>(index.GetInteger());
+
+		if (container.GetType() == ObjectType::Dict)
+		{
+			// Walks the slots, a dictionary modified by the body may skip or
+			// repeat entries as the PLRM allows
+			auto* dict = container.GetObject<ps::DictObject>();
+			while (i < dict->GetSlotCount() && dict->GetSlot(i).key.GetType() == ObjectType::None)
+				++i;
+			if (i >= dict->GetSlotCount())
+				return exec.Pop(3);
+			if (!b.Reserve(2))
+				return;
+			b.Push(dict->GetSlot(i).key);
+			b.Push(dict->GetSlot(i).value);
+		}
+		else
+		{
+			if (i >= container.GetLength())
+				return exec.Pop(3);
+			if (!b.Reserve(1))
+				return;
+			if (container.GetType() == ObjectType::Array)
+				b.Push(b.GetArray(container)[i]);
+			else
+				b.Push<int>(static_cast<uint8_t>(b.GetString(container)[i]));
+		}
+
+		index = Value(static_cast<int>(i + 1));
+		Iterate(b, Opcode::ForAllContinue);
+		}},
+
+	//%STOPPED_CONTINUE
+	{Opcode::StoppedContinue, "%stopped_continue", {}, [](Builtins& b) {
+		if (b.Reserve(1))
+			b.Push(false);
+		}},
 
 	/*
 	  //CEILING
-	  CreateOperand("ceiling", [this]() {
-		UnaryOp(std::ceil<>);
-	  });
+	  {"ceiling", {Number}, [](Builtins& b) {
+		b.UnaryOp(std::ceil<>);
+	  }},
 	*/
+};
+
+constexpr size_t s_operatorCount = sizeof(s_operators) / sizeof(s_operators[0]);
+static_assert(s_operatorCount == static_cast<size_t>(Opcode::Max), "Every opcode needs an operator");
+
+constexpr bool IsOrderedByOpcode()
+{
+	for (size_t i = 0; i < s_operatorCount; ++i)
+	{
+		if (static_cast<size_t>(s_operators[i].opcode) != i)
+			return false;
+	}
+	return true;
+}
+static_assert(IsOrderedByOpcode(), "Operators have to be listed in opcode order");
+constexpr ps::PerfectHash<s_operatorCount> s_operatorHash(s_operators, &ps::OperatorInfo::name);
+} // namespace
+
+const ps::OperatorInfo* ps::Operators::Find(std::string_view name)
+{
+	int index = s_operatorHash.Find(name);
+	if (index < 0 || s_operators[index].name != name)
+		return nullptr;
+
+	return &s_operators[index];
+}
+
+const ps::OperatorInfo& ps::Operators::Get(Opcode opcode)
+{
+	return s_operators[static_cast<size_t>(opcode)];
+}
+
+const ps::OperatorInfo* ps::Operators::GetTable()
+{
+	return s_operators;
+}
+
+size_t ps::Operators::GetCount()
+{
+	return s_operatorCount;
+}
+
+bool ps::Operators::UsesExecStack(Opcode opcode)
+{
+	switch (opcode)
+	{
+	case Opcode::Exec:
+	case Opcode::ExecStack:
+	case Opcode::CountExecStack:
+	case Opcode::If:
+	case Opcode::IfElse:
+	case Opcode::For:
+	case Opcode::Repeat:
+	case Opcode::Loop:
+	case Opcode::ForAll:
+	case Opcode::Exit:
+	case Opcode::Stop:
+	case Opcode::Stopped:
+	case Opcode::ForContinue:
+	case Opcode::RepeatContinue:
+	case Opcode::LoopContinue:
+	case Opcode::ForAllContinue:
+	case Opcode::StoppedContinue:
+		return true;
+	default:
+		return false;
+	}
+}
 
-	return m_dict;
+bool ps::Operators::IsPure(Opcode opcode)
+{
+	switch (opcode)
+	{
+	case Opcode::Add:
+	case Opcode::Div:
+	case Opcode::IDiv:
+	case Opcode::Mod:
+	case Opcode::Mul:
+	case Opcode::Sub:
+	case Opcode::Neg:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool ps::Operators::ChangesBindings(Opcode opcode)
+{
+	switch (opcode)
+	{
+	case Opcode::Begin:
+	case Opcode::End:
+	case Opcode::Def:
+	case Opcode::Undef:
+	case Opcode::Put:
+	case Opcode::Restore:
+		return true;
+	default:
+		return false;
+	}
 }
 
-std::stack<std::shared_ptr<ps::Object>>& ps::Builtins::GetStack()
+ps::DictObject* ps::Builtins::GetSystemDict()
+{
+	// Global VM isn't subject to save and restore, so nothing is journaled
+	static VM vm(false);
+	static DictObject* dict = [] {
+		auto* dict = DictObject::Create(vm, s_operatorCount + 8);
+
+		for (const auto& op : s_operators)
+		{
+			// loop continuations are internal
+			if (op.name[0] != '%')
+				dict->Put(vm, Value::Name(NameTable::Intern(op.name)), Value::Operator(op.opcode));
+		}
+
+		dict->Put(vm, Value::Name(NameTable::Intern("true")), Value(true));
+		dict->Put(vm, Value::Name(NameTable::Intern("false")), Value(false));
+		dict->Put(vm, Value::Name(NameTable::Intern("null")), Value(ObjectType::Null));
+		dict->Put(vm, Value::Name(NameTable::Intern("systemdict")), Value(dict));
+
+		// Shared by all interpreters, so it's never modified again
+		dict->SetAccess(ObjectAccess::ReadOnly);
+		return dict;
+	}();
+
+	return dict;
+}
+
+ps::Stack<ps::Value>& ps::Builtins::GetStack()
 {
 	return m_interpr->GetOperandStack();
-}
\ No newline at end of file
+}
+
+ps::Stack<ps::Value>& ps::Builtins::GetDictStack()
+{
+	return m_interpr->GetDictionaryStack();
+}
+
+ps::Stack<ps::Value>& ps::Builtins::GetExecStack()
+{
+	return m_interpr->GetExecutionStack();
+}
+
+bool ps::Builtins::Raise(Error error)
+{
+	m_interpr->SetError(error);
+	return false;
+}
+
+ps::Value ps::Builtins::ToKey(const Value& key)
+{
+	if (key.GetType() == ObjectType::String)
+		return Value::Name(NameTable::Intern(GetString(key)), false);
+
+	if (key.GetType() == ObjectType::Real)
+	{
+		// Only integral reals in the int range convert, NaN fails the
+		// comparisons
+		float real = key.GetReal();
+		if (real >= -2147483648.0f && real < 2147483648.0f && std::trunc(real) == real)
+			return Value(static_cast<int>(real));
+	}
+
+	return key;
+}
+
+char* ps::Builtins::GetWritableString(const Value& str, uint32_t offset, uint32_t count)
+{
+	if (str.GetAccess() != ObjectAccess::Unlimited)
+	{
+		Raise(Error::InvalidAccess);
+		return nullptr;
+	}
+
+	auto* storage = str.GetObject<StringObject>();
+	auto* data = storage->GetData() + str.GetOffset() + offset;
+	GetVM().Journal(storage, data, count);
+	return data;
+}
+
+ps::VM& ps::Builtins::GetVM()
+{
+	return m_interpr->GetVM();
+}
+
+ps::Value* ps::Builtins::GetWritableArray(const Value& array, uint32_t offset, uint32_t count)
+{
+	if (array.GetAccess() != ObjectAccess::Unlimited)
+	{
+		Raise(Error::InvalidAccess);
+		return nullptr;
+	}
+
+	auto* storage = array.GetObject<ArrayObject>();
+	auto* elements = GetArray(array) + offset;
+	GetVM().Journal(storage, elements, count * sizeof(Value));
+	storage->Invalidate(GetVM());
+	return elements;
+}
@@ -1,21 +1,36 @@
 #pragma once
-#include <map>
+#include <cmath>
 #include <memory>
 #include <string>
-#include "objects/operand.hpp"
-#include "objects/integer.hpp"
-#include "objects/real.hpp"
+#include <string_view>
+#include <vector>
+#include "error.hpp"
+#include "objects/array.hpp"
+#include "objects/dict.hpp"
+#include "objects/string.hpp"
+#include "operators.hpp"
+#include "stack.hpp"
+#include "value.hpp"
+#include "vm.hpp"
 
 namespace ps
 {
 class Interpreter;
 class Object;
 
+// Implementation of the builtin operators. An instance binds the operators
+// to one interpreter, the operators themselves are shared.
 class Builtins
 {
   public:
+    inline Builtins(Interpreter *interpr)
+    {
+      m_interpr = interpr;
+    }
 
-    std::map<std::string, std::shared_ptr<Object>>& CreateDictionary(Interpreter *interpr);
+    // The system dictionary is created once per process in global VM and
+    // shared read-only by all interpreters
+    static DictObject* GetSystemDict();
 
 	template<class T>
 	static inline T abs(const T& v)
@@ -23,120 +38,212 @@ class Builtins
 		return v < 0 ? -v : v;
 	}
 
-  private:
-    void CreateOperand(std::string_view name,std::function<void()> func);
-    std::stack<std::shared_ptr<Object>> & GetStack();
+    // Checks the operand count and types against the operator's signature
+    inline bool CheckOperands(const OperatorInfo& op)
+    {
+      if (GetStack().Size() < op.operandCount)
+        return Raise(Error::StackUnderflow);
 
-    inline std::shared_ptr<Object> Top()
+      return CheckTypes(op);
+    }
+
+    // Operand types only, the operands must be there
+    inline bool CheckTypes(const OperatorInfo& op)
     {
       auto& s = GetStack();
-      return s.top();
+      for (size_t i = 0; i < op.operandCount; ++i)
+      {
+        if (!(op.GetType(i) & TypeBit(s.Top(i).GetType())))
+          return Raise(Error::TypeCheck);
+      }
+
+      return true;
     }
 
-    inline std::shared_ptr<Object> Pop()
+    inline Interpreter& GetInterpreter()
     {
-      auto& s = GetStack();
-      auto result = s.top();
-      s.pop();
-      return result;
+      return *m_interpr;
     }
 
-    inline std::vector<std::shared_ptr<Object>> Pop(int n)
+    Stack<Value> & GetStack();
+    Stack<Value> & GetDictStack();
+    Stack<Value> & GetExecStack();
+    VM & GetVM();
+
+    // Dictionary keys are normalized, strings become names and integral
+    // reals become integers
+    Value ToKey(const Value& key);
+
+    // Characters of a string value
+    inline std::string_view GetString(const Value& str)
     {
-      std::vector<std::shared_ptr<Object>> result;
-      for(int i=0;i<n;++i)
-        result.push_back(Pop());
+      auto* storage = str.GetObject<StringObject>();
+      return std::string_view(storage->GetData() + str.GetOffset(), str.GetLength());
+    }
 
-      return result;
+    // Characters [offset, offset + count) of a string value prepared for
+    // writing, raises invalidaccess and returns nullptr for read-only strings
+    char* GetWritableString(const Value& str, uint32_t offset, uint32_t count);
+
+    // Elements of an array value
+    inline Value* GetArray(const Value& array)
+    {
+      return array.GetObject<ArrayObject>()->GetData() + array.GetOffset();
     }
 
-    template<class T>
-    inline T Pop()
+    // Elements [offset, offset + count) of an array value prepared for
+    // writing, raises invalidaccess and returns nullptr for read-only arrays
+    Value* GetWritableArray(const Value& array, uint32_t offset, uint32_t count);
+
+    // Sets the interpreter's error, always returns false
+    bool Raise(Error error);
+
+    // For operands beyond the operator's signature
+    inline bool Require(size_t n)
     {
-      return Cast<T>(Pop());
+      return GetStack().Size() >= n || Raise(Error::StackUnderflow);
     }
 
-    inline void Push(std::shared_ptr<Object> o)
+    inline bool Reserve(size_t n)
     {
-      auto& s = GetStack();
-      s.push(o);
+      return GetStack().GetFree() >= n || Raise(Error::StackOverflow);
     }
 
-    inline void Push(std::vector<std::shared_ptr<Object>>& objs)
+    inline bool ReserveExec(size_t n)
     {
-      for(auto o : objs)
-        Push(o);
+      return GetExecStack().GetFree() >= n || Raise(Error::ExecStackOverflow);
+    }
+
+    inline Value& Top(size_t n = 0)
+    {
+      return GetStack().Top(n);
+    }
+
+    inline Value Pop()
+    {
+      return GetStack().Pop();
     }
 
     template<class T>
-    inline void Push(T v);
+    inline T Pop()
+    {
+      return Cast<T>(Pop());
+    }
+
+    inline void Push(const Value& o)
+    {
+      GetStack().Push(o);
+    }
 
     template<class T>
-    inline T Cast(std::shared_ptr<Object>);
+    inline void Push(T v);
 
-    template<typename F>
-    inline void BinaryOp(F op)
+    template<class T>
+    inline T Cast(const Value&);
+
+    // Arithmetic on the two numbers on top of the stack, `a` below `b` as
+    // in "a b sub". The pair of operand types indexes a table of
+    // specializations, the result replaces both operands. `Op` provides
+    // `bool Integers(int, int, Value&)`, which may promote to real, and
+    // `float Reals(float, float)`; results that aren't finite raise
+    // undefinedresult.
+    template<class Op>
+    inline void Arithmetic()
     {
-      auto a = Pop();
-      auto b = Pop();
+      static constexpr Specialization table[] = {&IntInt<Op>, &IntReal<Op>, &RealInt<Op>, &RealReal<Op>};
 
-      if (a->GetType() == ObjectType::Integer && b->GetType() == ObjectType::Integer)
-      {
-        int ai = Cast<int>(a);
-        int bi = Cast<int>(b);
-        Push(op(ai,bi));
-      }
-      else
+      auto& s = GetStack();
+      const auto& a = s.Top(1);
+      const auto& b = s.Top(0);
+      size_t pair = (a.GetType() == ObjectType::Real) * 2 + (b.GetType() == ObjectType::Real);
+      Value result;
+      if (!table[pair](a, b, result))
       {
-        //TODO: implement double/real
+        Raise(Error::UndefinedResult);
+        return;
       }
+      s.Pop(1);
+      s.Top() = result;
     }
 
     template<typename F>
     inline void UnaryOp(F op)
     {
-      auto a = Pop();
+      auto& a = Top();
 
-      if (a->GetType() == ObjectType::Integer)
-      {
-        int ai = Cast<int>(a);
-        Push(op(ai));
-      }
+      if (a.GetType() == ObjectType::Integer)
+        a = Value(op(a.GetInteger()));
       else
-      {
-        //TODO: implement double/real
-      }
+        a = Value(static_cast<float>(op(a.GetReal())));
+    }
+
+  private:
+    using Specialization = bool (*)(const Value&, const Value&, Value&);
+
+    template<class Op>
+    static bool Reals(float a, float b, Value& result)
+    {
+      float real = Op::Reals(a, b);
+      result = Value(real);
+      return std::isfinite(real);
+    }
+
+    template<class Op>
+    static bool IntInt(const Value& a, const Value& b, Value& result)
+    {
+      return Op::Integers(a.GetInteger(), b.GetInteger(), result);
+    }
+
+    template<class Op>
+    static bool IntReal(const Value& a, const Value& b, Value& result)
+    {
+      return Reals<Op>(static_cast<float>(a.GetInteger()), b.GetReal(), result);
+    }
+
+    template<class Op>
+    static bool RealInt(const Value& a, const Value& b, Value& result)
+    {
+      return Reals<Op>(a.GetReal(), static_cast<float>(b.GetInteger()), result);
+    }
+
+    template<class Op>
+    static bool RealReal(const Value& a, const Value& b, Value& result)
+    {
+      return Reals<Op>(a.GetReal(), b.GetReal(), result);
     }
 
-    std::map<std::string, std::shared_ptr<Object>> m_dict;
     Interpreter* m_interpr;
 };
 
 template<>
 inline void Builtins::Push<int>(int v)
 {
-  auto& s = GetStack();
-  s.push(std::make_shared<IntegerObject>(v));
+  GetStack().Push(Value(v));
+}
+
+template<>
+inline void Builtins::Push<bool>(bool v)
+{
+  GetStack().Push(Value(v));
 }
 
 template<>
 inline void Builtins::Push<float>(float v)
 {
-  auto& s = GetStack();
-  s.push(std::make_shared<RealObject>(v));
+  GetStack().Push(Value(v));
 }
 
 template<>
-inline int Builtins::Cast<int>(std::shared_ptr<Object> o)
+inline int Builtins::Cast<int>(const Value& o)
 {
-  return o->Cast<IntegerObject>()->GetValue();
+  return o.GetInteger();
 }
 
 template<>
-inline float Builtins::Cast<float>(std::shared_ptr<Object> o)
+inline float Builtins::Cast<float>(const Value& o)
 {
-  return o->Cast<RealObject>()->GetValue();
+  return o.GetReal();
 }
 
 
-} // namespace ps
\ No newline at end of file
+} // namespace ps
@@ -0,0 +1,449 @@
+#include "compiler.hpp"
+#include "interpreter.hpp"
+#include "objects/array.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+using ps::ArrayObject;
+using ps::Bytecode;
+using ps::Compiler;
+using ps::InlineBody;
+using ps::InlineGuard;
+using ps::Instruction;
+using ps::ObjectType;
+using ps::Opcode;
+using ps::Operators;
+using ps::RegionInfo;
+using ps::TypeBit;
+using ps::TypeMask;
+using ps::Value;
+using namespace ps::operand;
+
+inline bool IsProc(const Value &value)
+{
+  return value.GetType() == ObjectType::Array && value.IsExecutable();
+}
+
+// Only bound operators are fused, names may be redefined at any time
+inline bool IsOperator(const Value &value, Opcode opcode)
+{
+  return value.GetType() == ObjectType::Operand && value.GetOpcode() == opcode;
+}
+
+inline bool IsInteger(const Value &value)
+{
+  return value.GetType() == ObjectType::Integer;
+}
+
+// Operator pairs fused into superinstructions. The table is static, picked
+// by hand from a one-off count of the procedure bodies in samples/ (which
+// can't run to completion yet, so there's no runtime profile): "exch def"
+// 47 times, "exch pop" 11 times. It isn't updated when the corpus changes.
+// Literal forms are matched in CompileElement, "n j roll" (30, mostly
+// "3 -1 roll") and "n index" save the most stack traffic, and a literal
+// followed by any other operator ("2 div" 20, "1 sub" 16, "1 add" 11) saves
+// one dispatch.
+struct FusedPair
+{
+  Opcode first;
+  Opcode second;
+  Bytecode fused;
+};
+
+constexpr FusedPair s_fusedPairs[] = {
+    {Opcode::Exch, Opcode::Def, Bytecode::ExchDef},
+    {Opcode::Exch, Opcode::Pop, Bytecode::ExchPop},
+};
+
+Instruction CompileElement(const Value *elements, uint32_t i, uint32_t length)
+{
+  const auto &element = elements[i];
+  uint32_t left = length - i;
+
+  if (IsProc(element))
+  {
+    if (left >= 2 && IsOperator(elements[i + 1], Opcode::If))
+      return {Bytecode::If, 2, Opcode::If, nullptr};
+    if (left >= 3 && IsProc(elements[i + 1]) && IsOperator(elements[i + 2], Opcode::IfElse))
+      return {Bytecode::IfElse, 3, Opcode::IfElse, nullptr};
+  }
+
+  if (!element.IsExecutable() || IsProc(element))
+  {
+    if (IsInteger(element) && left >= 2 && IsOperator(elements[i + 1], Opcode::Index))
+      return {Bytecode::Index, 2, Opcode::Index, nullptr};
+    if (IsInteger(element) && left >= 3 && IsInteger(elements[i + 1]) && IsOperator(elements[i + 2], Opcode::Roll))
+      return {Bytecode::Roll, 3, Opcode::Roll, nullptr};
+    if (left >= 2 && elements[i + 1].GetType() == ObjectType::Operand)
+      return {Bytecode::PushCall, 2, elements[i + 1].GetOpcode(), nullptr};
+    return {Bytecode::Literal, 1, Opcode::Max, nullptr};
+  }
+
+  switch (element.GetType())
+  {
+  case ObjectType::Operand:
+    if (left >= 2 && elements[i + 1].GetType() == ObjectType::Operand)
+    {
+      for (const auto &pair : s_fusedPairs)
+      {
+        if (element.GetOpcode() == pair.first && elements[i + 1].GetOpcode() == pair.second)
+          return {pair.fused, 2, pair.second, nullptr};
+      }
+    }
+    return {Bytecode::Operator, 1, element.GetOpcode(), nullptr};
+  case ObjectType::Null:
+    return {Bytecode::Nop, 1, Opcode::Max, nullptr};
+  default:
+    return {Bytecode::Generic, 1, Opcode::Max, nullptr};
+  }
+}
+
+// What a name inside an inlined procedure stands for, with the guard on
+// its binding
+struct Expansion
+{
+  std::vector<Value> elements;
+  std::vector<InlineGuard> guards;
+  // Guards are checked before the elements run, so once an element may
+  // rebind names no further names can be expanded
+  bool rebinds = false;
+};
+
+bool ExpandProc(ps::Interpreter &interpr, const Value &name, const Value &proc, uint32_t depth, Expansion &out);
+
+bool ExpandName(ps::Interpreter &interpr, const Value &name, uint32_t depth, Expansion &out)
+{
+  if (out.rebinds || depth > Compiler::MaxInlineDepth)
+    return false;
+
+  auto *value = interpr.DictLookup(name);
+  if (value == nullptr)
+    return false;
+  if (IsProc(*value))
+    return ExpandProc(interpr, name, *value, depth, out);
+  // unbound operators in wrappers that weren't bound
+  if (value->GetType() != ObjectType::Operand || Operators::UsesExecStack(value->GetOpcode()))
+    return false;
+
+  out.guards.push_back({name, *value, 0});
+  out.elements.push_back(*value);
+  out.rebinds = Operators::ChangesBindings(value->GetOpcode());
+  return true;
+}
+
+bool ExpandProc(ps::Interpreter &interpr, const Value &name, const Value &proc, uint32_t depth, Expansion &out)
+{
+  if (proc.GetLength() > Compiler::MaxInlineCallee)
+    return false;
+
+  auto *array = proc.GetObject<ArrayObject>();
+  out.guards.push_back({name, proc, array->GetVersion()});
+  const auto *elements = array->GetData() + proc.GetOffset();
+  for (uint32_t i = 0; i < proc.GetLength(); ++i)
+  {
+    const auto &element = elements[i];
+    if (!element.IsExecutable() || IsProc(element))
+      out.elements.push_back(element);
+    else if (element.GetType() == ObjectType::Operand && !Operators::UsesExecStack(element.GetOpcode()))
+    {
+      out.elements.push_back(element);
+      out.rebinds = out.rebinds || Operators::ChangesBindings(element.GetOpcode());
+    }
+    else if (element.GetType() == ObjectType::Name)
+    {
+      if (!ExpandName(interpr, element, depth + 1, out))
+        return false;
+    }
+    else if (element.GetType() != ObjectType::Null)
+      return false;
+
+    if (out.elements.size() > Compiler::MaxInlineLength)
+      return false;
+  }
+  return true;
+}
+
+const InlineBody *CreateBody(ps::VM &vm, const std::vector<InlineGuard> &guards, const std::vector<Value> &elements)
+{
+  auto *guardCopy = static_cast<InlineGuard *>(vm.Allocate(guards.size() * sizeof(InlineGuard), alignof(InlineGuard)));
+  std::copy(guards.begin(), guards.end(), guardCopy);
+  auto length = static_cast<uint32_t>(elements.size());
+  auto *array = ArrayObject::Create(vm, length);
+  std::copy(elements.begin(), elements.end(), array->GetData());
+  auto proc = Value::Array(array, 0, length);
+  proc.SetExecutable(true);
+
+  auto *body = static_cast<InlineBody *>(vm.Allocate(sizeof(InlineBody), alignof(InlineBody)));
+  *body = {guardCopy, static_cast<uint32_t>(guards.size()), length, array->GetData(), proc};
+  return body;
+}
+
+// A name bound to a thin wrapper procedure, such as the `/l {_c lineto}`
+// definitions of generated prologs, becomes the wrapper's elements
+Instruction CompileCall(ps::VM &vm, ps::Interpreter &interpr, const Value &name)
+{
+  Instruction generic = {Bytecode::Generic, 1, Opcode::Max, nullptr};
+  auto *value = interpr.DictLookup(name);
+  if (value == nullptr || !IsProc(*value) || value->GetLength() == 0)
+    return generic;
+
+  Expansion expansion;
+  if (!ExpandProc(interpr, name, *value, 0, expansion) || expansion.elements.empty())
+    return generic;
+
+  return {Bytecode::Inline, 1, Opcode::Max, CreateBody(vm, expansion.guards, expansion.elements)};
+}
+
+// Constant folding: pure operators applied to literals are evaluated at
+// compile time, stack operators shuffle them, and if and ifelse on a
+// literal condition keep only the branch taken, which is called with exec.
+// The run of elements becomes an Inline instruction without guards,
+// pushing the values left.
+Instruction CompileConstants(ps::VM &vm, ps::Interpreter &interpr, const Value *elements, uint32_t i,
+                             uint32_t length)
+{
+  std::vector<Value> values;
+  std::vector<Value> folded;
+  std::vector<InlineGuard> guards;
+  uint32_t end = i;
+  for (uint32_t j = i; j < length && j - i < Compiler::MaxFoldSpan; ++j)
+  {
+    const auto &element = elements[j];
+    if (!element.IsExecutable() || IsProc(element))
+    {
+      values.push_back(element);
+      continue;
+    }
+    if (element.GetType() == ObjectType::Name)
+    {
+      // names such as true and false, guarded like inlined procedures
+      auto *value = interpr.DictLookup(element);
+      if (value == nullptr || value->IsExecutable() || value->IsComposite())
+        break;
+      guards.push_back({element, *value, 0});
+      values.push_back(*value);
+      continue;
+    }
+    if (element.GetType() != ObjectType::Operand)
+      break;
+
+    auto opcode = element.GetOpcode();
+    auto count = Operators::Get(opcode).operandCount;
+    if (values.size() < count)
+      break;
+
+    if (opcode == Opcode::Pop || opcode == Opcode::Exch || opcode == Opcode::Dup)
+    {
+      if (opcode == Opcode::Pop)
+        values.pop_back();
+      else if (opcode == Opcode::Exch)
+        std::swap(values[values.size() - 1], values[values.size() - 2]);
+      else
+        values.push_back(values.back());
+      folded = values;
+      end = j + 1;
+      continue;
+    }
+    auto *operands = values.data() + values.size() - count;
+
+    if (opcode == Opcode::If || opcode == Opcode::IfElse)
+    {
+      bool branches = IsProc(operands[count - 1]) && (opcode == Opcode::If || IsProc(operands[1]));
+      if (operands[0].GetType() != ObjectType::Boolean || !branches)
+        break;
+
+      bool condition = operands[0].GetBoolean();
+      Value taken = opcode == Opcode::If ? operands[1] : operands[condition ? 1 : 2];
+      values.resize(values.size() - count);
+      folded = values;
+      end = j + 1;
+      if (opcode == Opcode::If && !condition)
+        continue;
+      folded.push_back(taken);
+      folded.push_back(Value::Operator(Opcode::Exec));
+      break;
+    }
+
+    Value result;
+    if (!Operators::IsPure(opcode) || !interpr.Evaluate(opcode, operands, count, result))
+      break;
+    values.resize(values.size() - count);
+    values.push_back(result);
+    folded = values;
+    end = j + 1;
+  }
+
+  if (end == i)
+    return {Bytecode::Generic, 1, Opcode::Max, nullptr};
+  return {Bytecode::Inline, static_cast<uint8_t>(end - i), Opcode::Max, CreateBody(vm, guards, folded)};
+}
+
+// Stack effects of the operators regions may contain, besides exch, dup,
+// cvx and cvlit whose results have the types of their operands. The
+// operands are the operator's signature, so all of these leave the
+// execution stack alone and push a fixed number of results.
+struct StackEffect
+{
+  Opcode opcode;
+  uint8_t results;
+  TypeMask type;
+};
+
+constexpr StackEffect s_stackEffects[] = {
+    {Opcode::Pop, 0, 0},
+    {Opcode::Count, 1, Integer},
+    {Opcode::Mark, 1, TypeBit(ObjectType::Mark)},
+    {Opcode::CountToMark, 1, Integer},
+    {Opcode::Add, 1, Number},
+    {Opcode::Div, 1, TypeBit(ObjectType::Real)},
+    {Opcode::IDiv, 1, Integer},
+    {Opcode::Mod, 1, Integer},
+    {Opcode::Mul, 1, Number},
+    {Opcode::Sub, 1, Number},
+    {Opcode::Neg, 1, Number},
+    {Opcode::Dict, 1, Dict},
+    {Opcode::Length, 1, Integer},
+    {Opcode::MaxLength, 1, Integer},
+    {Opcode::Begin, 0, 0},
+    {Opcode::End, 0, 0},
+    {Opcode::Def, 0, 0},
+    {Opcode::Load, 1, Any},
+    {Opcode::Known, 1, Boolean},
+    {Opcode::CurrentDict, 1, Dict},
+    {Opcode::CountDictStack, 1, Integer},
+    {Opcode::String, 1, String},
+    {Opcode::Get, 1, Any},
+    {Opcode::Put, 0, 0},
+    {Opcode::Array, 1, Array},
+    {Opcode::XCheck, 1, Boolean},
+};
+
+const StackEffect *FindStackEffect(Opcode opcode)
+{
+  static constexpr StackEffect sameType = {Opcode::Max, 0, 0};
+  if (opcode == Opcode::Exch || opcode == Opcode::Dup || opcode == Opcode::Cvx || opcode == Opcode::Cvlit)
+    return &sameType;
+  for (const auto &effect : s_stackEffects)
+  {
+    if (effect.opcode == opcode)
+      return &effect;
+  }
+  return nullptr;
+}
+
+// Straight-line regions: runs of literals and operators with a known stack
+// effect. The region's effect on the operand stack is computed with the
+// types of the values it pushes, values from below it have any type.
+Instruction CompileRegion(ps::VM &vm, const Value *elements, uint32_t i, uint32_t length)
+{
+  Instruction none = {Bytecode::Generic, 1, Opcode::Max, nullptr};
+  std::vector<TypeMask> types;
+  std::vector<uint8_t> typeChecks;
+  uint32_t below = 0;
+  uint32_t growth = 0;
+  bool operators = false;
+
+  uint32_t j = i;
+  for (; j < length && j - i < Compiler::MaxRegionLength; ++j)
+  {
+    const auto &element = elements[j];
+    if (!element.IsExecutable() || IsProc(element))
+    {
+      types.push_back(TypeBit(element.GetType()));
+      typeChecks.push_back(0);
+    }
+    else if (element.GetType() == ObjectType::Operand)
+    {
+      auto opcode = element.GetOpcode();
+      const auto *effect = FindStackEffect(opcode);
+      if (effect == nullptr)
+        break;
+
+      const auto &op = Operators::Get(opcode);
+      TypeMask operands[ps::OperatorInfo::MaxOperands];
+      bool known = true;
+      for (size_t k = 0; k < op.operandCount; ++k)
+      {
+        if (types.empty())
+        {
+          operands[k] = Any;
+          ++below;
+        }
+        else
+        {
+          operands[k] = types.back();
+          types.pop_back();
+        }
+        known = known && (operands[k] & ~op.GetType(k)) == 0;
+      }
+
+      if (opcode == Opcode::Exch)
+      {
+        types.push_back(operands[0]);
+        types.push_back(operands[1]);
+      }
+      else if (opcode == Opcode::Dup)
+        types.insert(types.end(), 2, operands[0]);
+      else if (opcode == Opcode::Cvx || opcode == Opcode::Cvlit)
+        types.push_back(operands[0]);
+      else
+        types.insert(types.end(), effect->results, effect->type);
+
+      typeChecks.push_back(!known);
+      operators = true;
+    }
+    else
+      break;
+
+    if (types.size() > below)
+      growth = std::max(growth, static_cast<uint32_t>(types.size() - below));
+  }
+
+  if (j - i < Compiler::MinRegionLength || !operators)
+    return none;
+
+  auto *checks = static_cast<uint8_t *>(vm.Allocate(typeChecks.size(), 1));
+  std::copy(typeChecks.begin(), typeChecks.end(), checks);
+  auto *region = static_cast<RegionInfo *>(vm.Allocate(sizeof(RegionInfo), alignof(RegionInfo)));
+  *region = {below, growth, checks};
+
+  Instruction instr = {Bytecode::Region, static_cast<uint8_t>(j - i), Opcode::Max, nullptr};
+  instr.region = region;
+  return instr;
+}
+} // namespace
+
+ps::Instruction *ps::Compiler::Compile(VM &vm, const ArrayObject &array, Interpreter &interpr)
+{
+  auto length = array.GetLength();
+  const auto *elements = array.GetData();
+  auto *code = static_cast<Instruction *>(vm.Allocate(length * sizeof(Instruction), alignof(Instruction)));
+  // Elements inside a region get their instructions as well, for
+  // intervals and resuming after errors
+  uint32_t regionEnd = 0;
+  for (uint32_t i = 0; i < length; ++i)
+  {
+    if (interpr.GetConstantFolding())
+    {
+      code[i] = CompileConstants(vm, interpr, elements, i, length);
+      if (code[i].op != Bytecode::Generic)
+        continue;
+    }
+    if (i >= regionEnd)
+    {
+      code[i] = CompileRegion(vm, elements, i, length);
+      if (code[i].op == Bytecode::Region)
+      {
+        regionEnd = i + code[i].span;
+        continue;
+      }
+    }
+    code[i] = CompileElement(elements, i, length);
+    if (code[i].op == Bytecode::Generic && elements[i].GetType() == ObjectType::Name)
+      code[i] = CompileCall(vm, interpr, elements[i]);
+  }
+  return code;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include "operators.hpp"
+#include "value.hpp"
+
+namespace ps
+{
+class ArrayObject;
+class Interpreter;
+class VM;
+
+enum class Bytecode : uint8_t
+{
+  // Executes the element like the interpreter would
+  Generic,
+  // Pushes the element, procedures included
+  Literal,
+  Operator,
+  Nop,
+  // proc if
+  If,
+  // proc proc ifelse
+  IfElse,
+  // A literal followed by an operator, such as a procedure and a loop
+  PushCall,
+  // Superinstructions for the most frequent operator sequences, see the
+  // fusion table in compiler.cpp
+  ExchDef,
+  ExchPop,
+  // n index
+  Index,
+  // n j roll
+  Roll,
+  // A name bound to a small procedure, whose elements run in place, or
+  // folded constants
+  Inline,
+  // A straight-line region of literals and operators with a known stack
+  // effect, checked once for stack depth and free space
+  Region,
+};
+
+// A name expanded by an Inline instruction, with the procedure it resolved
+// to at compile time and the procedure's version
+struct InlineGuard
+{
+  Value name;
+  Value proc;
+  uint32_t version;
+};
+
+// Elements an Inline instruction runs instead of calling the procedure:
+// literals and operators that leave the execution stack alone. They're
+// only valid while all guards hold.
+struct InlineBody
+{
+  const InlineGuard *guards;
+  uint32_t guardCount;
+  uint32_t length;
+  const Value *elements;
+  // The elements as an executable array, when one fails the rest of it
+  // runs like the rest of a called procedure would
+  Value proc;
+};
+
+// Checks of a Region instruction, from a static analysis of its elements
+struct RegionInfo
+{
+  // Operands the region takes from below it, and how far it grows the
+  // operand stack at most
+  uint32_t depth;
+  uint32_t growth;
+  // Per element, whether the operator's operand types still have to be
+  // checked; types known from literals and earlier results are not
+  const uint8_t *typeChecks;
+};
+
+// One instruction per element of an array, indexed like the elements. An
+// instruction may cover the elements after it (`span`); those still get
+// their own instructions, so execution can start at any element.
+struct Instruction
+{
+  Bytecode op;
+  uint8_t span;
+  Opcode opcode;
+  union {
+    const InlineBody *body;
+    const RegionInfo *region;
+  };
+};
+
+// Lowers executable arrays to bytecode, the interpreter compiles a
+// procedure the first time it runs it. Names are resolved through the
+// interpreter's dictionary stack to inline thin wrapper procedures, and
+// constant expressions are folded unless the interpreter disables it.
+class Compiler
+{
+public:
+  // Limits on inlining: the elements of one callee, the elements after
+  // expanding nested wrappers and the nesting depth
+  static constexpr uint32_t MaxInlineCallee = 4;
+  static constexpr uint32_t MaxInlineLength = 8;
+  static constexpr uint32_t MaxInlineDepth = 3;
+  // Elements scanned for constant folding from each element
+  static constexpr uint32_t MaxFoldSpan = 32;
+  // Shorter regions gain nothing over the fused instructions
+  static constexpr uint32_t MinRegionLength = 3;
+  static constexpr uint32_t MaxRegionLength = 255;
+
+  static Instruction *Compile(VM &vm, const ArrayObject &array, Interpreter &interpr);
+};
+} // namespace ps
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+
+namespace ps
+{
+// PostScript errors as listed in the PLRM, section 8.1 "errordict"
+enum class Error : uint8_t
+{
+  None,
+  ConfigurationError,
+  DictFull,
+  DictStackOverflow,
+  DictStackUnderflow,
+  ExecStackOverflow,
+  HandleError,
+  Interrupt,
+  InvalidAccess,
+  InvalidExit,
+  InvalidFileAccess,
+  InvalidFont,
+  InvalidRestore,
+  IOError,
+  LimitCheck,
+  NoCurrentPoint,
+  RangeCheck,
+  StackOverflow,
+  StackUnderflow,
+  SyntaxError,
+  Timeout,
+  TypeCheck,
+  Undefined,
+  UndefinedFilename,
+  UndefinedResource,
+  UndefinedResult,
+  UnmatchedMark,
+  Unregistered,
+  VMError,
+};
+
+inline const char *GetErrorName(Error error)
+{
+  static const char *names[] = {
+      "",
+      "configurationerror",
+      "dictfull",
+      "dictstackoverflow",
+      "dictstackunderflow",
+      "execstackoverflow",
+      "handleerror",
+      "interrupt",
+      "invalidaccess",
+      "invalidexit",
+      "invalidfileaccess",
+      "invalidfont",
+      "invalidrestore",
+      "ioerror",
+      "limitcheck",
+      "nocurrentpoint",
+      "rangecheck",
+      "stackoverflow",
+      "stackunderflow",
+      "syntaxerror",
+      "timeout",
+      "typecheck",
+      "undefined",
+      "undefinedfilename",
+      "undefinedresource",
+      "undefinedresult",
+      "unmatchedmark",
+      "unregistered",
+      "VMerror",
+  };
+
+  return names[static_cast<uint8_t>(error)];
+}
+} // namespace ps
@@ -0,0 +1,68 @@
+#include "inputbuffer.hpp"
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PS_MMAP 1
+#else
+#define PS_MMAP 0
+#endif
+
+ps::InputBuffer::InputBuffer(std::istream &input)
+    : m_owned(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>())
+{
+}
+
+ps::InputBuffer::~InputBuffer()
+{
+  Close();
+}
+
+bool ps::InputBuffer::Open(const char *path)
+{
+  Close();
+
+#if PS_MMAP
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+  {
+    void *data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+    {
+      // the scanner reads front to back
+      ::madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+      ::close(fd);
+      m_mapped = static_cast<const char *>(data);
+      m_size = static_cast<size_t>(info.st_size);
+      return true;
+    }
+  }
+  ::close(fd);
+#endif
+
+  // empty files, pipes and platforms without mmap
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  m_owned.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+void ps::InputBuffer::Close()
+{
+#if PS_MMAP
+  if (m_mapped)
+    ::munmap(const_cast<char *>(m_mapped), m_size);
+#endif
+  m_mapped = nullptr;
+  m_size = 0;
+  m_owned.clear();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace ps
+{
+// Program text as one contiguous span for the scanner: a memory-mapped file,
+// or an owned copy of a stream such as a pipe
+class InputBuffer
+{
+public:
+  InputBuffer() = default;
+  // Reads the stream to its end
+  explicit InputBuffer(std::istream &input);
+  ~InputBuffer();
+
+  InputBuffer(const InputBuffer &) = delete;
+  InputBuffer &operator=(const InputBuffer &) = delete;
+
+  // Maps the file, or reads it where mapping isn't available. Returns
+  // false if it can't be opened.
+  bool Open(const char *path);
+
+  inline std::string_view GetData() const
+  {
+    return m_mapped ? std::string_view(m_mapped, m_size) : std::string_view(m_owned);
+  }
+
+private:
+  void Close();
+
+  std::string m_owned;
+  const char *m_mapped = nullptr;
+  size_t m_size = 0;
+};
+} // namespace ps
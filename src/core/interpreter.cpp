@@ -1,69 +1,834 @@
 #include "interpreter.hpp"
 #include "parser.hpp"
 #include "builtins.hpp"
-#include "objects/name.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "nametable.hpp"
+#include "objects/array.hpp"
+#include "objects/file.hpp"
+#include "objects/string.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <utility>
 
-ps::Interpreter::Interpreter(ScriptMode mode)
+ps::Interpreter::Interpreter(ScriptMode mode, const StackLimits &limits)
+    : m_opStack(limits.operandStack), m_dictStack(limits.dictStack), m_execStack(limits.execStack),
+      m_builtins(this), m_jit(std::make_unique<Jit>(*this))
 {
   m_mode = mode;
-  m_systemDict = m_builtins.CreateDictionary(this);
+  m_systemDict = Builtins::GetSystemDict();
 
-  m_dictStack.push_back(m_systemDict);
+  // systemdict is shared, so userdict is found through itself
+  m_userDict = DictObject::Create(m_vm, 200);
+  m_userDict->Put(m_vm, Value::Name(NameTable::Intern("userdict")), Value(m_userDict));
+
+  // errordict and $error belong in systemdict, which is shared and
+  // read-only here
+  m_errorDict = DictObject::Create(m_vm, 32);
+  for (auto error = static_cast<uint8_t>(Error::ConfigurationError); error <= static_cast<uint8_t>(Error::VMError);
+       ++error)
+  {
+    auto name = Value::Name(NameTable::Intern(GetErrorName(static_cast<Error>(error))));
+    m_errorDict->Put(m_vm, name, Value::Operator(Opcode::Stop));
+  }
+  m_userDict->Put(m_vm, Value::Name(NameTable::Intern("errordict")), Value(m_errorDict));
+
+  m_errorState = DictObject::Create(m_vm, 8);
+  m_errorState->Put(m_vm, Value::Name(NameTable::Intern("newerror")), Value(false));
+  m_userDict->Put(m_vm, Value::Name(NameTable::Intern("$error")), Value(m_errorState));
+
+  m_dictStack.Push(Value(m_systemDict));
+  m_dictStack.Push(Value(m_userDict));
+}
+
+ps::Interpreter::~Interpreter() = default;
+
+bool ps::Interpreter::PushExec(const Value &obj)
+{
+  if (m_execStack.GetFree() == 0)
+  {
+    SetError(Error::ExecStackOverflow);
+    return false;
+  }
+
+  m_execStack.Push(obj);
+  return true;
+}
+
+void ps::Interpreter::PushOperand(const Value &obj)
+{
+  if (m_opStack.GetFree() == 0)
+    SetError(Error::StackOverflow);
+  else
+    m_opStack.Push(obj);
+}
+
+// Computed goto where the compiler supports it, a switch otherwise
+#if defined(__GNUC__)
+#define PS_THREADED_DISPATCH 1
+#else
+#define PS_THREADED_DISPATCH 0
+#endif
+
+void ps::Interpreter::RunCode(Value &obj)
+{
+  auto &frame = m_execStack.Top();
+  auto *array = frame.GetObject<ArrayObject>();
+  const Value *elements = array->GetData();
+  const Instruction *code = array->GetCode();
+  const Value proc = frame;
+  uint32_t pc = frame.GetOffset();
+  uint32_t end = pc + frame.GetLength();
+  size_t depth = m_execStack.Size();
+  const size_t frameIndex = depth - 1;
+  Instruction instr;
+
+#if PS_THREADED_DISPATCH
+  static void *const labels[] = {&&Generic, &&Literal, &&Operator, &&Nop,     &&If,
+                                 &&IfElse,  &&PushCall, &&ExchDef,  &&ExchPop, &&Index, &&Roll,
+                                 &&Inline,  &&Region};
+#endif
+
+next:
+  instr = code[pc];
+  // a fused instruction can't extend past the end of an interval
+  if (pc + instr.span > end)
+    instr = {Bytecode::Generic, 1, Opcode::Max, nullptr};
+  pc += instr.span;
+
+  // The frame is updated before anything runs, so operators see the
+  // execution stack as it is. The procedure is done before its last
+  // instruction runs, so tail calls don't grow the execution stack.
+  if (pc == end)
+  {
+    m_execStack.Pop();
+    --depth;
+  }
+  else
+    frame = frame.GetInterval(instr.span, end - pc);
+
+#if PS_THREADED_DISPATCH
+  goto *labels[static_cast<size_t>(instr.op)];
+#else
+  switch (instr.op)
+  {
+  case Bytecode::Generic:
+    goto Generic;
+  case Bytecode::Literal:
+    goto Literal;
+  case Bytecode::Operator:
+    goto Operator;
+  case Bytecode::Nop:
+    goto Nop;
+  case Bytecode::If:
+    goto If;
+  case Bytecode::IfElse:
+    goto IfElse;
+  case Bytecode::PushCall:
+    goto PushCall;
+  case Bytecode::ExchDef:
+    goto ExchDef;
+  case Bytecode::ExchPop:
+    goto ExchPop;
+  case Bytecode::Index:
+    goto Index;
+  case Bytecode::Roll:
+    goto Roll;
+  case Bytecode::Inline:
+    goto Inline;
+  case Bytecode::Region:
+    goto Region;
+  }
+#endif
+
+Generic:
+  ExecuteObject(elements[pc - 1]);
+  goto check;
+
+Literal:
+  PushOperand(elements[pc - 1]);
+  goto check;
+
+Operator:
+  ExecuteOperator(instr.opcode);
+  goto check;
+
+Nop:
+  goto check;
+
+If:
+  if (!m_opStack.Empty() && m_opStack.Top().GetType() == ObjectType::Boolean)
+  {
+    ++m_operatorCount;
+    if (m_opStack.Pop().GetBoolean())
+      PushExec(elements[pc - 2]);
+    goto check;
+  }
+  goto PushCall;
+
+IfElse:
+  if (!m_opStack.Empty() && m_opStack.Top().GetType() == ObjectType::Boolean)
+  {
+    ++m_operatorCount;
+    PushExec(m_opStack.Pop().GetBoolean() ? elements[pc - 3] : elements[pc - 2]);
+    goto check;
+  }
+  // the operator reports the error with its operands in place
+  PushOperand(elements[pc - 3]);
+  if (m_error == Error::None)
+    goto PushCall;
+  goto check;
+
+PushCall:
+  PushOperand(elements[pc - 2]);
+  if (m_error == Error::None)
+    ExecuteOperator(instr.opcode);
+  goto check;
+
+ExchDef:
+  if (m_opStack.Size() >= 2 &&
+      m_dictStack.Top().GetObject<DictObject>()->GetAccess() == ObjectAccess::Unlimited)
+  {
+    auto key = m_builtins.ToKey(m_opStack.Top(0));
+    auto value = m_opStack.Top(1);
+    m_opStack.Pop(2);
+    Define(m_dictStack.Top().GetObject<DictObject>(), key, value);
+    m_operatorCount += 2;
+    goto check;
+  }
+  goto Unfused;
+
+ExchPop:
+  if (m_opStack.Size() >= 2)
+  {
+    m_opStack.Top(1) = m_opStack.Top(0);
+    m_opStack.Pop(1);
+    m_operatorCount += 2;
+    goto check;
+  }
+  goto Unfused;
+
+Index:
+{
+  int n = elements[pc - 2].GetInteger();
+  if (n >= 0 && static_cast<size_t>(n) < m_opStack.Size() && m_opStack.GetFree() >= 1)
+  {
+    m_opStack.Push(m_opStack.Top(n));
+    ++m_operatorCount;
+    goto check;
+  }
+  goto Unfused;
+}
+
+Roll:
+{
+  int n = elements[pc - 3].GetInteger();
+  int j = elements[pc - 2].GetInteger();
+  if (n > 0 && static_cast<size_t>(n) <= m_opStack.Size())
+  {
+    m_opStack.Roll(n, ((j % n) + n) % n);
+    ++m_operatorCount;
+    goto check;
+  }
+  goto Unfused;
 }
 
-void ps::Interpreter::RunFunction(std::shared_ptr<Object> obj)
+Inline:
+  if (IsInlineValid(*instr.body))
+  {
+    for (uint32_t i = 0; i < instr.body->length; ++i)
+    {
+      const auto &element = instr.body->elements[i];
+      if (element.IsExecutable() && element.GetType() == ObjectType::Operand)
+        ExecuteOperator(element.GetOpcode());
+      else
+        PushOperand(element);
+      if (m_error != Error::None)
+      {
+        // The rest of the body runs before the rest of this procedure,
+        // like the rest of a call
+        obj = element;
+        const auto &rest = instr.body->proc;
+        if (i + 1 < rest.GetLength())
+          PushExec(rest.GetInterval(i + 1, rest.GetLength() - i - 1));
+        return;
+      }
+    }
+    goto check;
+  }
+  // A name was redefined or a callee changed, the procedure is recompiled
+  // the next time it's entered
+  array->Invalidate(m_vm);
+  goto Unfused;
+
+Region:
 {
-  // a builtin function
-  if (obj->GetType() == ObjectType::Operand)
+  // The stack depth and free space were computed for the whole region, so
+  // the elements run without checks unless the analysis left a type open
+  const auto &region = *instr.region;
+  uint32_t start = pc - instr.span;
+  if (m_opStack.Size() < region.depth || m_opStack.GetFree() < region.growth)
+    goto Unfused;
+  for (uint32_t i = 0; i < instr.span; ++i)
+  {
+    const auto &element = elements[start + i];
+    if (!element.IsExecutable() || element.GetType() != ObjectType::Operand)
+    {
+      m_opStack.Push(element);
+      continue;
+    }
+
+    ++m_operatorCount;
+    switch (element.GetOpcode())
+    {
+    case Opcode::Pop:
+      m_opStack.Pop(1);
+      continue;
+    case Opcode::Exch:
+      std::swap(m_opStack.Top(0), m_opStack.Top(1));
+      continue;
+    case Opcode::Dup:
+      m_opStack.Copy(1);
+      continue;
+    default:
+      break;
+    }
+
+    auto &op = Operators::Get(element.GetOpcode());
+    if (!region.typeChecks[i] || m_builtins.CheckTypes(op))
+      op.func(m_builtins);
+    if (m_error != Error::None)
+    {
+      ResumeAfter(proc, start + i + 1, end, pc, frameIndex);
+      obj = element;
+      return;
+    }
+  }
+  goto check;
+}
+
+// Fused instructions run their elements one by one when the fast path
+// doesn't apply, so errors are raised as without fusion
+Unfused:
+  for (uint32_t i = pc - instr.span; i < pc; ++i)
+  {
+    ExecuteObject(elements[i]);
+    if (m_error != Error::None)
+    {
+      ResumeAfter(proc, i + 1, end, pc, frameIndex);
+      obj = elements[i];
+      return;
+    }
+    // a call runs before the remaining elements
+    if (m_execStack.Size() != depth)
+    {
+      ResumeAfter(proc, i + 1, end, pc, frameIndex);
+      return;
+    }
+  }
+  goto check;
+
+check:
+  if (m_error != Error::None)
   {
-    obj->Cast<OperandObject>()->Execute();
+    obj = elements[pc - 1];
+    return;
   }
+  // Back to the main loop once another procedure was scheduled, a loop
+  // exited or this one is done
+  if (pc == end || m_execStack.Size() != depth)
+    return;
+  goto next;
 }
 
-std::shared_ptr<ps::Object> ps::Interpreter::DictLookup(std::shared_ptr<Object> name)
+void ps::Interpreter::ResumeAfter(const Value &proc, uint32_t next, uint32_t end, uint32_t pc, size_t frame)
 {
-  auto str = name->Cast<NameObject>()->GetName();
+  if (next == pc)
+    return;
 
-  for (auto rit = m_dictStack.rbegin(); rit != m_dictStack.rend(); ++rit)
+  // The rest of the procedure from `next`. Its frame was already moved past
+  // the instruction, or popped with its last one and has to be put back
+  // below whatever was scheduled since.
+  auto rest = proc.GetInterval(next - proc.GetOffset(), end - next);
+  if (pc != end)
   {
-    auto key = rit->find(str);
-    if (key != rit->end())
+    m_execStack[frame] = rest;
+    return;
+  }
+
+  if (!PushExec(rest))
+    return;
+  for (size_t i = m_execStack.Size() - 1; i > frame; --i)
+    std::swap(m_execStack[i], m_execStack[i - 1]);
+}
+
+bool ps::Interpreter::IsInlineValid(const InlineBody &body)
+{
+  for (uint32_t i = 0; i < body.guardCount; ++i)
+  {
+    const auto &guard = body.guards[i];
+    auto *value = DictLookup(guard.name);
+    if (value == nullptr || std::memcmp(value, &guard.proc, sizeof(Value)) != 0)
+      return false;
+    if (value->GetType() == ObjectType::Array &&
+        value->GetObject<ArrayObject>()->GetVersion() != guard.version)
+      return false;
+  }
+  return true;
+}
+
+// Executes an object encountered in a procedure or file, or popped from the
+// execution stack. Nothing here recurses: procedures are pushed on the
+// execution stack and run by the loop in Execute.
+void ps::Interpreter::ExecuteObject(const Value &obj)
+{
+  if (!obj.IsExecutable())
+    return PushOperand(obj);
+
+  switch (obj.GetType())
+  {
+  case ObjectType::Operand:
+    return ExecuteOperator(obj.GetOpcode());
+  case ObjectType::Name:
+  {
+    auto *value = DictLookup(obj);
+    if (value == nullptr)
+      return SetError(Error::Undefined);
+    if (value->GetType() == ObjectType::Operand)
+      return ExecuteOperator(value->GetOpcode());
+    if (!value->IsExecutable())
+      return PushOperand(*value);
+    // an empty procedure has nothing to run
+    if (value->GetType() != ObjectType::Null &&
+        (value->GetType() != ObjectType::Array || value->GetLength() != 0))
+      PushExec(*value);
+    return;
+  }
+  case ObjectType::Null:
+    return;
+  case ObjectType::String:
+    // Read by Execute like a file
+    if (obj.GetLength() != 0)
+      PushExec(obj);
+    return;
+  default:
+    // Procedures are only run when they're called by name or exec, when
+    // encountered directly they're data
+    return PushOperand(obj);
+  }
+}
+
+void ps::Interpreter::ExecuteOperator(Opcode opcode)
+{
+  ++m_operatorCount;
+  // The hottest operators are handled inline for their common case, all
+  // others and every error case go through the operator table
+  switch (opcode)
+  {
+  case Opcode::Add:
+  case Opcode::Sub:
+  case Opcode::Mul:
+    // integers that don't overflow, "a b sub" computes a - b
+    if (m_opStack.Size() >= 2 && m_opStack.Top(0).GetType() == ObjectType::Integer &&
+        m_opStack.Top(1).GetType() == ObjectType::Integer)
     {
-      return key->second;
+      int a = m_opStack.Top(1).GetInteger();
+      int b = m_opStack.Top(0).GetInteger();
+      int result;
+      bool overflow;
+      if (opcode == Opcode::Add)
+        overflow = util::AddOverflow(a, b, result);
+      else if (opcode == Opcode::Sub)
+        overflow = util::SubOverflow(a, b, result);
+      else
+        overflow = util::MulOverflow(a, b, result);
+      if (!overflow)
+      {
+        m_opStack.Pop(1);
+        m_opStack.Top() = Value(result);
+        return;
+      }
     }
+    break;
+  case Opcode::Exch:
+    if (m_opStack.Size() >= 2)
+      return std::swap(m_opStack.Top(0), m_opStack.Top(1));
+    break;
+  case Opcode::Dup:
+    if (m_opStack.Size() >= 1 && m_opStack.GetFree() >= 1)
+      return m_opStack.Copy(1);
+    break;
+  case Opcode::Pop:
+    if (m_opStack.Size() >= 1)
+      return m_opStack.Pop(1);
+    break;
+  default:
+    break;
   }
 
-  std::cerr << "Missing name: " << str << std::endl;
+  auto &op = Operators::Get(opcode);
+  if (m_builtins.CheckOperands(op))
+    op.func(m_builtins);
+}
+
+bool ps::Interpreter::Evaluate(Opcode opcode, const Value *operands, size_t count, Value &result)
+{
+  if (m_opStack.GetFree() < count)
+    return false;
+
+  auto size = m_opStack.Size();
+  for (size_t i = 0; i < count; ++i)
+    m_opStack.Push(operands[i]);
+
+  auto &op = Operators::Get(opcode);
+  if (m_builtins.CheckOperands(op))
+    op.func(m_builtins);
+
+  bool ok = m_error == Error::None && m_opStack.Size() == size + 1;
+  if (ok)
+    result = m_opStack.Top();
+  m_error = Error::None;
+  m_opStack.Pop(m_opStack.Size() - size);
+  return ok;
+}
+
+const ps::Value *ps::Interpreter::DictLookup(const Value &name)
+{
+  auto atom = name.GetAtom();
+  if (atom < m_bindings.size() && m_bindings[atom].epoch == m_dictEpoch)
+    return m_bindings[atom].value;
+
+  for (size_t i = 0; i < m_dictStack.Size(); ++i)
+  {
+    if (auto *value = m_dictStack.Top(i).GetObject<DictObject>()->Find(name))
+    {
+      if (atom >= m_bindings.size())
+        m_bindings.resize(atom + 1, Binding{nullptr, 0});
+      m_bindings[atom] = {value, m_dictEpoch};
+      return value;
+    }
+  }
 
   return nullptr;
 }
 
-bool ps::Interpreter::Load(std::istream &input)
+bool ps::Interpreter::BeginDict(const Value &dict)
 {
-  Parser parser(input);
+  if (m_dictStack.GetFree() == 0)
+  {
+    SetError(Error::DictStackOverflow);
+    return false;
+  }
 
-  while (auto obj = parser.GetObject())
+  m_dictStack.Push(dict);
+  ++m_dictEpoch;
+  return true;
+}
+
+bool ps::Interpreter::EndDict()
+{
+  // systemdict and userdict can't be popped
+  if (m_dictStack.Size() <= 2)
   {
-    //Push literal objects to the operand stack
-    if (!obj->IsExecutable())
-      m_opStack.push(obj);
+    SetError(Error::DictStackUnderflow);
+    return false;
+  }
+
+  m_dictStack.Pop();
+  ++m_dictEpoch;
+  return true;
+}
+
+void ps::Interpreter::Define(DictObject *dict, const Value &key, const Value &value)
+{
+  if (dict->GetAccess() != ObjectAccess::Unlimited)
+    return SetError(Error::InvalidAccess);
+
+  auto slots = dict->GetSlotCount();
+
+  // Replacing a value keeps its slot, so cached bindings stay valid. A new
+  // key may shadow another definition and growing moves every slot.
+  if (dict->Put(m_vm, key, value))
+  {
+    if (slots != dict->GetSlotCount())
+      ++m_dictEpoch;
     else
+      InvalidateBinding(key);
+  }
+}
+
+bool ps::Interpreter::Undefine(DictObject *dict, const Value &key)
+{
+  if (dict->GetAccess() != ObjectAccess::Unlimited)
+  {
+    SetError(Error::InvalidAccess);
+    return false;
+  }
+
+  // Removal shifts entries of the same probe sequence to other slots
+  if (!dict->Remove(m_vm, key))
+    return false;
+
+  ++m_dictEpoch;
+  return true;
+}
+
+bool ps::Interpreter::Restore(const Value &save)
+{
+  auto level = save.GetSaveLevel();
+  if (!m_vm.IsValidSave(level, save.GetSaveId()))
+  {
+    SetError(Error::InvalidRestore);
+    return false;
+  }
+
+  // Objects created after the save are discarded, nothing may refer to them
+  auto isNewer = [level](const Value &value) {
+    if (!value.IsComposite())
+      return false;
+    auto objectLevel = value.GetObject<Object>()->GetSaveLevel();
+    return objectLevel >= level && objectLevel != Object::GlobalLevel;
+  };
+  if (std::any_of(m_opStack.begin(), m_opStack.end(), isNewer) ||
+      std::any_of(m_dictStack.begin(), m_dictStack.end(), isNewer) ||
+      std::any_of(m_execStack.begin(), m_execStack.end(), isNewer))
+  {
+    SetError(Error::InvalidRestore);
+    return false;
+  }
+
+  m_vm.Restore(level, save.GetSaveId());
+  InvalidateBindings();
+  m_jit->Restored();
+  return true;
+}
+
+void ps::Interpreter::InvalidateBinding(const Value &key)
+{
+  if (key.GetType() == ObjectType::Name && key.GetAtom() < m_bindings.size())
+    m_bindings[key.GetAtom()].epoch = 0;
+}
+
+bool ps::Interpreter::Load(std::istream &input)
+{
+  Parser parser(input, *this);
+  return Run(parser);
+}
+
+bool ps::Interpreter::Load(std::string_view input)
+{
+  Parser parser(input, *this);
+  return Run(parser);
+}
+
+bool ps::Interpreter::Run(Parser &parser)
+{
+  // Lives exactly as long as the file is on the execution stack
+  FileObject file(&parser);
+
+  auto base = m_execStack.Size();
+  if (!PushExec(Value(&file)))
+  {
+    m_error = Error::None;
+    return false;
+  }
+
+  return Execute(base);
+}
+
+bool ps::Interpreter::Execute(size_t base)
+{
+  Value obj;
+  while (m_execStack.Size() > base)
+  {
+    auto &top = m_execStack.Top();
+    switch (top.GetType())
     {
-      if (obj->GetType() == ObjectType::Name)
+    case ObjectType::Array:
+    {
+      if (top.GetLength() == 0)
       {
-        //lookup in the dictionary
-        auto value = DictLookup(obj);
+        m_execStack.Pop();
+        continue;
+      }
 
-        //lookup failed
-        if (value == nullptr)
-          return false;
+      auto *array = top.GetObject<ArrayObject>();
+      // Hot procedures run as native code when they're called
+      if (top.GetOffset() == 0 && top.GetLength() == array->GetLength())
+      {
+        if (auto *native = m_jit->Enter(*array))
+        {
+          auto count = m_jit->Run(native, *array);
+          if (m_error != Error::None)
+          {
+            // A handler that returns continues after the failed element
+            obj = array->GetData()[count - 1];
+            auto &frame = m_execStack.Top();
+            if (count == frame.GetLength())
+              m_execStack.Pop();
+            else
+              frame = frame.GetInterval(count, frame.GetLength() - count);
+            break;
+          }
+          m_execStack.Pop();
+          continue;
+        }
+      }
+
+      if (!array->GetCode())
+        array->SetCode(m_vm, Compiler::Compile(m_vm, *array, *this));
+      RunCode(obj);
+      if (m_error == Error::None)
+        continue;
+      break;
+    }
+    case ObjectType::File:
+    {
+      auto *parser = top.GetObject<FileObject>()->GetParser();
+      if (parser->GetObject(obj))
+        break;
 
-        RunFunction(value);
+      obj = m_execStack.Pop();
+      if (parser->GetError() == Error::None)
+        continue;
+      SetError(parser->GetError());
+      break;
+    }
+    case ObjectType::String:
+    {
+      // Executable strings are read a token at a time like files, the
+      // rest of the string stays on the execution stack
+      std::string_view text(top.GetObject<StringObject>()->GetData() + top.GetOffset(), top.GetLength());
+      Parser parser(text, *this);
+      if (!parser.GetObject(obj))
+      {
+        obj = m_execStack.Pop();
+        if (parser.GetError() == Error::None)
+          continue;
+        SetError(parser.GetError());
+        break;
       }
+
+      auto offset = static_cast<uint32_t>(parser.GetOffset());
+      if (offset == top.GetLength())
+        m_execStack.Pop();
+      else
+        top = top.GetInterval(offset, top.GetLength() - offset);
+      if (!parser.HasPending())
+        break;
+
+      // The other objects of a binary object sequence run as the elements
+      // of a procedure would
+      std::vector<Value> sequence{obj};
+      for (Value next; parser.HasPending() && parser.GetObject(next);)
+        sequence.push_back(next);
+      auto *array = ArrayObject::Create(m_vm, static_cast<uint32_t>(sequence.size()));
+      std::copy(sequence.begin(), sequence.end(), array->GetData());
+      auto proc = Value::Array(array, 0, array->GetLength());
+      proc.SetExecutable(true);
+      if (PushExec(proc))
+        continue;
+      break;
+    }
+    default:
+      // operators and continuations scheduled by operators
+      obj = m_execStack.Pop();
+      break;
+    }
+
+    if (m_error == Error::None)
+      ExecuteObject(obj);
+
+    // Errors unwind through their handler, whose default is stop
+    if (m_error != Error::None && !HandleError(obj))
+    {
+      std::cerr << "%%[ Error: " << GetErrorName(m_error) << "; OffendingCommand: ";
+      PrintCommand(obj);
+      std::cerr << " ]%%" << std::endl;
+      m_error = Error::None;
+      m_execStack.Pop(m_execStack.Size() - base);
+      return false;
     }
   }
 
+  // stop ended the job
+  return !std::exchange(m_jobStopped, false);
+}
+
+bool ps::Interpreter::HandleError(const Value &obj)
+{
+  auto name = Value::Name(NameTable::Intern(GetErrorName(m_error)), false);
+  auto *handler = m_errorDict->Find(name);
+  if (handler == nullptr || m_execStack.GetFree() == 0)
+    return false;
+
+  m_error = Error::None;
+  // A syntax error's file is the interpreter's own, it isn't handed out
+  auto command = obj.GetType() == ObjectType::File ? Value(ObjectType::Null) : obj;
+  m_errorState->Put(m_vm, Value::Name(NameTable::Intern("newerror")), Value(true));
+  m_errorState->Put(m_vm, Value::Name(NameTable::Intern("errorname")), name);
+  m_errorState->Put(m_vm, Value::Name(NameTable::Intern("command")), command);
+
+  // The operands are left in place with the offending object on top. A
+  // full stack is dropped, as there's no other way to make room.
+  if (m_opStack.GetFree() == 0)
+    m_opStack.Clear();
+  m_opStack.Push(command);
+  m_execStack.Push(*handler);
   return true;
 }
+
+bool ps::Interpreter::Stop()
+{
+  for (size_t i = 0; i < m_execStack.Size(); ++i)
+  {
+    auto &entry = m_execStack.Top(i);
+    if (entry.GetType() == ObjectType::Operand && entry.GetOpcode() == Opcode::StoppedContinue)
+    {
+      m_execStack.Pop(i + 1);
+      if (m_opStack.GetFree() == 0)
+        m_opStack.Clear();
+      m_opStack.Push(Value(true));
+      return true;
+    }
+    if (entry.GetType() == ObjectType::File)
+    {
+      m_execStack.Pop(i + 1);
+      break;
+    }
+    if (i + 1 == m_execStack.Size())
+      m_execStack.Clear();
+  }
+
+  m_jobStopped = true;
+  ReportError();
+  return false;
+}
+
+void ps::Interpreter::ReportError()
+{
+  auto newError = Value::Name(NameTable::Intern("newerror"));
+  auto *pending = m_errorState->Find(newError);
+  if (!pending || pending->GetType() != ObjectType::Boolean || !pending->GetBoolean())
+    return;
+
+  std::cerr << "%%[ Error: ";
+  if (auto *name = m_errorState->Find(Value::Name(NameTable::Intern("errorname"))))
+    PrintCommand(*name);
+  std::cerr << "; OffendingCommand: ";
+  if (auto *command = m_errorState->Find(Value::Name(NameTable::Intern("command"))))
+    PrintCommand(*command);
+  std::cerr << " ]%%" << std::endl;
+  m_errorState->Put(m_vm, newError, Value(false));
+}
+
+void ps::Interpreter::PrintCommand(const Value &obj)
+{
+  if (obj.GetType() == ObjectType::Name)
+    std::cerr << NameTable::GetName(obj.GetAtom());
+  else if (obj.GetType() == ObjectType::Operand)
+    std::cerr << Operators::Get(obj.GetOpcode()).name;
+}
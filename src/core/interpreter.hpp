@@ -1,41 +1,208 @@
 #pragma once
 #include <istream>
-#include <stack>
-#include <deque>
-#include <map>
+#include <string_view>
+#include <vector>
 #include <memory>
 #include "builtins.hpp"
+#include "error.hpp"
+#include "objects/dict.hpp"
+#include "stack.hpp"
+#include "value.hpp"
+#include "vm.hpp"
 #include "pscore_export.hpp"
 
 namespace ps
 {
-class Object;
 enum class ScriptMode
 {
   Standalone,
   Embedded,
 };
 
+// Stack capacities, the defaults are the Level 2 implementation limits
+struct StackLimits
+{
+  size_t operandStack = 500;
+  size_t dictStack = 20;
+  size_t execStack = 250;
+};
+
+class Jit;
+class Parser;
+struct InlineBody;
+
 class PSCORE_EXPORT Interpreter
 {
 public:
-  Interpreter(ScriptMode mode = ScriptMode::Standalone);
+  Interpreter(ScriptMode mode = ScriptMode::Standalone, const StackLimits &limits = StackLimits());
+  ~Interpreter();
   bool Load(std::istream &input);
+  // Runs program text that outlives the call, such as a memory-mapped
+  // ps::InputBuffer
+  bool Load(std::string_view input);
 
-  inline std::stack<std::shared_ptr<Object>> &GetOperandStack()
+  inline Stack<Value> &GetOperandStack()
   {
     return m_opStack;
   }
 
+  // Dictionary values, the current dictionary is on top
+  inline Stack<Value> &GetDictionaryStack()
+  {
+    return m_dictStack;
+  }
+
+  // Procedures, files and operator continuations being executed. Whatever
+  // is on top runs next: procedures and files hand out one object at a time,
+  // anything else is popped and executed.
+  inline Stack<Value> &GetExecutionStack()
+  {
+    return m_execStack;
+  }
+
+  // Schedules an executable object to run once the current operator
+  // returns, raises execstackoverflow if there's no room
+  bool PushExec(const Value &obj);
+
+  // Raises a PostScript error, it's reported once the current operator
+  // returns
+  inline void SetError(Error error)
+  {
+    m_error = error;
+  }
+
+  inline Error GetError() const
+  {
+    return m_error;
+  }
+
+  inline DictObject *GetSystemDict()
+  {
+    return m_systemDict;
+  }
+
+  inline DictObject *GetUserDict()
+  {
+    return m_userDict;
+  }
+
+  // Error handlers by error name, they run with the offending object pushed
+  // on the operand stack. The defaults are stop.
+  inline DictObject *GetErrorDict()
+  {
+    return m_errorDict;
+  }
+
+  // Unwinds the execution stack to the innermost stopped context, which
+  // then pushes true. Outside of one the current file's job ends and the
+  // pending error is reported, returns false.
+  bool Stop();
+
+  // Dictionary stack manipulation, these keep the name binding cache valid
+  bool BeginDict(const Value &dict);
+  bool EndDict();
+  // Raises invalidaccess for read-only dictionaries such as systemdict
+  void Define(DictObject *dict, const Value &key, const Value &value);
+  bool Undefine(DictObject *dict, const Value &key);
+
+  // Restores the VM to the state of a save object, raises invalidrestore if
+  // the stacks still reference newer composite objects
+  bool Restore(const Value &save);
+
+  // Drops all cached name bindings, needed whenever dictionary contents
+  // change behind the interpreter's back (e.g. restore)
+  inline void InvalidateBindings()
+  {
+    ++m_dictEpoch;
+  }
+
+  // Local VM, composite objects created by the program live here
+  inline VM &GetVM()
+  {
+    return m_vm;
+  }
+
+  const Value *DictLookup(const Value &name);
+
+  // Constant folding in compiled procedures, on by default. Procedures
+  // compiled before a change keep their code.
+  inline void SetConstantFolding(bool enabled)
+  {
+    m_constantFolding = enabled;
+  }
+
+  inline bool GetConstantFolding() const
+  {
+    return m_constantFolding;
+  }
+
+  // Runs a pure operator on constant operands for the compiler, false if
+  // it fails. The interpreter's state is left as it was.
+  bool Evaluate(Opcode opcode, const Value *operands, size_t count, Value &result);
+
+  // Operators executed so far, native code excluded
+  inline uint64_t GetOperatorCount() const
+  {
+    return m_operatorCount;
+  }
+
 private:
-  std::shared_ptr<Object> DictLookup(std::shared_ptr<Object> name);
-  void RunFunction(std::shared_ptr<Object> func);
+  friend class Jit;
+
+  // Where a name resolved to, valid as long as `epoch` equals m_dictEpoch
+  struct Binding
+  {
+    const Value *value;
+    uint32_t epoch;
+  };
+
+  void InvalidateBinding(const Value &key);
+  // Runs the objects read by `parser` as a file on the execution stack
+  bool Run(Parser &parser);
+  // Runs the execution stack until only `base` entries are left
+  bool Execute(size_t base);
+  // Schedules the errordict handler for the pending error, false if
+  // there's none or no room for it
+  bool HandleError(const Value &obj);
+  // Prints the error recorded in $error, like handleerror
+  void ReportError();
+  // Names and operators, anything else prints nothing
+  void PrintCommand(const Value &obj);
+  // Runs the compiled procedure on top of the execution stack until it
+  // calls another procedure, returns or fails. `obj` is set to the
+  // offending element on failure.
+  void RunCode(Value &obj);
+  // Whether the procedures inlined by a compiled procedure are still the
+  // ones its names resolve to
+  bool IsInlineValid(const InlineBody &body);
+  // Points the frame of `proc`, at index `frame` of the execution stack,
+  // at element `next` when an instruction covering several elements stops
+  // early: on errors, so handlers that return resume there, and on calls.
+  // `pc` is where the frame points.
+  void ResumeAfter(const Value &proc, uint32_t next, uint32_t end, uint32_t pc, size_t frame);
+  void ExecuteObject(const Value &obj);
+  void PushOperand(const Value &obj);
+  void ExecuteOperator(Opcode opcode);
 
 private:
-  std::stack<std::shared_ptr<Object>> m_opStack;
-  std::deque<std::map<std::string, std::shared_ptr<Object>>> m_dictStack;
-  std::map<std::string, std::shared_ptr<Object>> m_systemDict;
+  VM m_vm;
+  Stack<Value> m_opStack;
+  Stack<Value> m_dictStack;
+  Stack<Value> m_execStack;
+  DictObject *m_systemDict;
+  DictObject *m_userDict;
+  DictObject *m_errorDict;
+  // $error, what the last error was
+  DictObject *m_errorState;
+  std::vector<Binding> m_bindings;
+  uint32_t m_dictEpoch = 1;
   Builtins m_builtins;
+  std::unique_ptr<Jit> m_jit;
   ScriptMode m_mode;
+  Error m_error = Error::None;
+  // Set when stop ended a job
+  bool m_jobStopped = false;
+  bool m_constantFolding = true;
+  uint64_t m_operatorCount = 0;
 };
 } // namespace ps
\ No newline at end of file
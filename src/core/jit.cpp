@@ -0,0 +1,362 @@
+#include "jit.hpp"
+#include "interpreter.hpp"
+#include "objects/array.hpp"
+#include "operators.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#ifdef PS_JIT
+#include <asmjit/x86.h>
+#endif
+
+// Passed to the native code, which keeps the stack top in a register and
+// stores it back before calling into the interpreter
+struct ps::Jit::Context
+{
+  Value *top;
+  Value *bottom;
+  Value *limit;
+  Interpreter *interpr;
+  const Value *elements;
+};
+
+#ifdef PS_JIT
+struct ps::Jit::Runtime
+{
+  asmjit::JitRuntime runtime;
+};
+#else
+struct ps::Jit::Runtime
+{
+};
+#endif
+
+#ifdef PS_JIT
+namespace
+{
+using ps::ObjectType;
+using ps::Opcode;
+using ps::Operators;
+using ps::Value;
+
+// Bound procedures of literals and operators that don't look at the
+// execution stack. The others schedule procedures or unwind loops, which
+// native code can't follow.
+bool IsCompilable(const Value *elements, uint32_t length)
+{
+  for (uint32_t i = 0; i < length; ++i)
+  {
+    const auto &element = elements[i];
+    if (element.IsExecutable() &&
+        (element.GetType() != ObjectType::Operand || Operators::UsesExecStack(element.GetOpcode())))
+      return false;
+  }
+  return length > 0;
+}
+
+inline bool IsOperator(const Value &value, Opcode opcode)
+{
+  return value.GetType() == ObjectType::Operand && value.GetOpcode() == opcode;
+}
+
+// The two 64 bit halves of a value, to be stored as immediates
+struct Bits
+{
+  uint64_t header;
+  uint64_t payload;
+};
+
+inline Bits GetBits(const Value &value)
+{
+  Bits bits;
+  std::memcpy(&bits, &value, sizeof(Value));
+  return bits;
+}
+} // namespace
+#endif
+
+ps::Jit::Jit(Interpreter &interpr) : m_interpr(interpr)
+{
+}
+
+ps::Jit::~Jit() = default;
+
+const void *ps::Jit::Enter(ArrayObject &array)
+{
+  if (auto *native = array.GetNative())
+    return native;
+
+  // Compilation is tried once, when the count reaches the threshold. Arrays
+  // in global VM may be shared with other interpreters and their code.
+  if (array.CountCall() != Threshold || array.GetSaveLevel() == Object::GlobalLevel)
+    return nullptr;
+
+  if (m_restoredTo != UINT16_MAX || m_compiled.size() >= m_sweepAt)
+    Sweep();
+
+  auto *native = Compile(array);
+  if (native)
+  {
+    auto &vm = m_interpr.GetVM();
+    array.SetNative(vm, native);
+    m_compiled.push_back({&array, native, vm.GetLevel()});
+  }
+  return native;
+}
+
+void ps::Jit::Restored()
+{
+  m_restoredTo = std::min(m_restoredTo, m_interpr.GetVM().GetLevel());
+}
+
+void ps::Jit::Sweep()
+{
+  // Code compiled after a save that was restored since is gone with its
+  // array or its journaled pointer. Replaced code of the current level
+  // can't be brought back either, while older code may still be in the
+  // journal.
+  auto level = std::min(m_restoredTo, m_interpr.GetVM().GetLevel());
+  auto end = std::remove_if(m_compiled.begin(), m_compiled.end(), [&](const Compiled &compiled) {
+    if (compiled.level < level || (compiled.level == level && compiled.array->GetNative() == compiled.native))
+      return false;
+#ifdef PS_JIT
+    m_runtime->runtime.release(const_cast<void *>(compiled.native));
+#endif
+    return true;
+  });
+  m_compiled.erase(end, m_compiled.end());
+  m_restoredTo = UINT16_MAX;
+  m_sweepAt = std::max<size_t>(64, m_compiled.size() * 2);
+}
+
+uint32_t ps::Jit::Run(const void *native, const ArrayObject &array)
+{
+  auto &stack = m_interpr.GetOperandStack();
+  Context ctx{stack.end(), stack.begin(), stack.begin() + stack.GetCapacity(), &m_interpr, array.GetData()};
+  auto function = reinterpret_cast<uint32_t (*)(Context *)>(const_cast<void *>(native));
+  auto count = function(&ctx);
+  stack.SetEnd(ctx.top);
+  return count;
+}
+
+// Runs one element in the interpreter, for operators without a fast path
+// and failed guards
+bool ps::Jit::Step(Context *ctx, uint32_t index)
+{
+  auto &interpr = *ctx->interpr;
+  auto &stack = interpr.GetOperandStack();
+  stack.SetEnd(ctx->top);
+  interpr.ExecuteObject(ctx->elements[index]);
+  ctx->top = stack.end();
+  return interpr.GetError() == Error::None;
+}
+
+const void *ps::Jit::Compile(const ArrayObject &array)
+{
+#ifdef PS_JIT
+  using namespace asmjit;
+
+  const Value *elements = array.GetData();
+  uint32_t length = array.GetLength();
+  if (!IsCompilable(elements, length))
+    return nullptr;
+
+  if (!m_runtime)
+    m_runtime = std::make_unique<Runtime>();
+
+  CodeHolder code;
+  code.init(m_runtime->runtime.codeInfo());
+  x86::Compiler cc(&code);
+  cc.addFunc(FuncSignatureT<uint32_t, Context *>(CallConv::kIdHost));
+
+  x86::Gp ctx = cc.newIntPtr("ctx");
+  x86::Gp sp = cc.newIntPtr("sp");
+  x86::Gp bottom = cc.newIntPtr("bottom");
+  x86::Gp limit = cc.newIntPtr("limit");
+  x86::Gp result = cc.newUInt32("result");
+  Label exit = cc.newLabel();
+
+  cc.setArg(0, ctx);
+  cc.mov(sp, x86::ptr(ctx, offsetof(Context, top)));
+  cc.mov(bottom, x86::ptr(ctx, offsetof(Context, bottom)));
+  cc.mov(limit, x86::ptr(ctx, offsetof(Context, limit)));
+
+  // Values are 16 bytes, the type is the first byte and the payload the
+  // second half (see ps::Value)
+  constexpr int32_t Size = sizeof(Value);
+  constexpr int32_t Payload = 8;
+  // Address of the value `n` counted from the top
+  auto top = [&](int32_t n, int32_t offset = 0) { return x86::ptr(sp, -(n + 1) * Size + offset); };
+
+  auto requireDepth = [&](uint32_t n, const Label &fail) {
+    x86::Gp end = cc.newIntPtr();
+    cc.lea(end, x86::ptr(bottom, static_cast<int32_t>(n) * Size));
+    cc.cmp(sp, end);
+    cc.jb(fail);
+  };
+  auto requireFree = [&](const Label &fail) {
+    cc.cmp(sp, limit);
+    cc.jae(fail);
+  };
+  auto requireType = [&](int32_t n, ObjectType type, const Label &fail) {
+    cc.cmp(x86::byte_ptr(sp, -(n + 1) * Size), static_cast<uint8_t>(type));
+    cc.jne(fail);
+  };
+  auto store = [&](const x86::Mem &dst, uint64_t bits) {
+    x86::Gp tmp = cc.newUInt64();
+    cc.mov(tmp, imm(bits));
+    cc.mov(dst, tmp);
+  };
+
+  for (uint32_t i = 0; i < length;)
+  {
+    const auto &element = elements[i];
+    Label slow = cc.newLabel();
+    Label next = cc.newLabel();
+    uint32_t span = 1;
+
+    if (!element.IsExecutable())
+    {
+      int n = element.GetType() == ObjectType::Integer ? element.GetInteger() : -1;
+      if (n >= 0 && n < 1024 && i + 1 < length && IsOperator(elements[i + 1], Opcode::Index))
+      {
+        // n index copies a value from a fixed depth
+        span = 2;
+        requireDepth(n + 1, slow);
+        requireFree(slow);
+        x86::Xmm value = cc.newXmm();
+        cc.movups(value, top(n));
+        cc.movups(x86::ptr(sp), value);
+        cc.add(sp, Size);
+      }
+      else
+      {
+        auto bits = GetBits(element);
+        requireFree(slow);
+        store(x86::qword_ptr(sp), bits.header);
+        store(x86::qword_ptr(sp, 8), bits.payload);
+        cc.add(sp, Size);
+      }
+    }
+    else
+    {
+      auto opcode = element.GetOpcode();
+      switch (opcode)
+      {
+      case Opcode::Pop:
+        requireDepth(1, slow);
+        cc.sub(sp, Size);
+        break;
+      case Opcode::Dup:
+      {
+        requireDepth(1, slow);
+        requireFree(slow);
+        x86::Xmm value = cc.newXmm();
+        cc.movups(value, top(0));
+        cc.movups(x86::ptr(sp), value);
+        cc.add(sp, Size);
+        break;
+      }
+      case Opcode::Exch:
+      {
+        requireDepth(2, slow);
+        x86::Xmm a = cc.newXmm();
+        x86::Xmm b = cc.newXmm();
+        cc.movups(a, top(0));
+        cc.movups(b, top(1));
+        cc.movups(top(1), a);
+        cc.movups(top(0), b);
+        break;
+      }
+      case Opcode::Add:
+      case Opcode::Sub:
+      case Opcode::Mul:
+      {
+        // integer and real operands of the same type, the result replaces
+        // the lower operand. Overflows and results that aren't finite are
+        // left to the interpreter.
+        Label real = cc.newLabel();
+        requireDepth(2, slow);
+        requireType(0, ObjectType::Integer, real);
+        requireType(1, ObjectType::Integer, real);
+        x86::Gp a = cc.newInt32();
+        cc.mov(a, top(1, Payload));
+        if (opcode == Opcode::Add)
+          cc.add(a, top(0, Payload));
+        else if (opcode == Opcode::Sub)
+          cc.sub(a, top(0, Payload));
+        else
+          cc.imul(a, top(0, Payload));
+        cc.jo(slow);
+        store(top(1), GetBits(Value(0)).header);
+        cc.mov(x86::dword_ptr(sp, -2 * Size + Payload), a);
+        cc.mov(x86::dword_ptr(sp, -2 * Size + Payload + 4), 0);
+        cc.sub(sp, Size);
+        cc.jmp(next);
+
+        cc.bind(real);
+        requireType(0, ObjectType::Real, slow);
+        requireType(1, ObjectType::Real, slow);
+        x86::Xmm x = cc.newXmmSs();
+        cc.movss(x, top(1, Payload));
+        if (opcode == Opcode::Add)
+          cc.addss(x, top(0, Payload));
+        else if (opcode == Opcode::Sub)
+          cc.subss(x, top(0, Payload));
+        else
+          cc.mulss(x, top(0, Payload));
+        // x - x is NaN exactly when x is infinite or NaN
+        x86::Xmm check = cc.newXmmSs();
+        cc.movss(check, x);
+        cc.subss(check, x);
+        cc.ucomiss(check, check);
+        cc.jp(slow);
+        store(top(1), GetBits(Value(0.0f)).header);
+        cc.movss(x86::dword_ptr(sp, -2 * Size + Payload), x);
+        cc.mov(x86::dword_ptr(sp, -2 * Size + Payload + 4), 0);
+        cc.sub(sp, Size);
+        break;
+      }
+      default:
+        cc.jmp(slow);
+        break;
+      }
+    }
+    cc.jmp(next);
+
+    // The interpreter runs the elements covered by the fast path
+    cc.bind(slow);
+    cc.mov(x86::ptr(ctx, offsetof(Context, top)), sp);
+    for (uint32_t j = i; j < i + span; ++j)
+    {
+      x86::Gp ok = cc.newUInt8();
+      auto *call = cc.call(imm(reinterpret_cast<void *>(&Jit::Step)),
+                           FuncSignatureT<bool, Context *, uint32_t>(CallConv::kIdHost));
+      call->setArg(0, ctx);
+      call->setArg(1, imm(j));
+      call->setRet(0, ok);
+      cc.mov(sp, x86::ptr(ctx, offsetof(Context, top)));
+      cc.mov(result, j + 1);
+      cc.test(ok, ok);
+      cc.jz(exit);
+    }
+    cc.bind(next);
+    i += span;
+  }
+
+  cc.mov(result, length);
+  cc.bind(exit);
+  cc.mov(x86::ptr(ctx, offsetof(Context, top)), sp);
+  cc.ret(result);
+  cc.endFunc();
+
+  void *function = nullptr;
+  if (cc.finalize() != kErrorOk || m_runtime->runtime.add(&function, &code) != kErrorOk)
+    return nullptr;
+  return function;
+#else
+  (void)array;
+  return nullptr;
+#endif
+}
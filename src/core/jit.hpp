@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ps
+{
+class ArrayObject;
+class Interpreter;
+
+// Compiles hot procedures to native code with asmjit. Only bound procedures
+// made of literals and operators that leave the execution stack alone
+// qualify. Literals and the most common operators are emitted inline behind
+// type and depth guards. Everything else, including every failed guard,
+// calls back into the interpreter for that one element.
+//
+// Builds without PS_JIT (anything but x86-64) never compile anything.
+class Jit
+{
+public:
+  // Calls of a procedure before it's compiled
+  static constexpr uint32_t Threshold = 32;
+
+  explicit Jit(Interpreter &interpr);
+  ~Jit();
+
+  // Counts a call of `array`, returns its native code once it's hot and
+  // nullptr otherwise
+  const void *Enter(ArrayObject &array);
+
+  // Runs the native code of `array`. Returns the number of elements
+  // executed, which is less than the array's length on error.
+  uint32_t Run(const void *native, const ArrayObject &array);
+
+  // Must be called after the VM was restored, code compiled since the save
+  // is released before the next compilation
+  void Restored();
+
+private:
+  struct Context;
+  struct Runtime;
+
+  // Native code and the save level it was compiled at
+  struct Compiled
+  {
+    const ArrayObject *array;
+    const void *native;
+    uint16_t level;
+  };
+
+  static bool Step(Context *ctx, uint32_t index);
+  const void *Compile(const ArrayObject &array);
+  // Releases the code nothing can reach anymore
+  void Sweep();
+
+  Interpreter &m_interpr;
+  // created with the first compiled procedure
+  std::unique_ptr<Runtime> m_runtime;
+  std::vector<Compiled> m_compiled;
+  // Sweeps when m_compiled grows to this, or after a restore
+  size_t m_sweepAt = 64;
+  uint16_t m_restoredTo = UINT16_MAX;
+};
+} // namespace ps
@@ -0,0 +1,49 @@
+#include "nametable.hpp"
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <unordered_map>
+
+ps::NameObject *ps::NameTable::s_chunks[MaxChunks];
+
+namespace
+{
+struct NameIndex
+{
+  std::mutex mutex;
+  std::unordered_map<std::string_view, uint32_t> atoms;
+  uint32_t count = 0;
+};
+
+NameIndex &GetIndex()
+{
+  static NameIndex index;
+  return index;
+}
+} // namespace
+
+uint32_t ps::NameTable::Intern(std::string_view name)
+{
+  auto &index = GetIndex();
+  std::lock_guard<std::mutex> lock(index.mutex);
+
+  auto it = index.atoms.find(name);
+  if (it != index.atoms.end())
+    return it->second;
+
+  uint32_t atom = index.count;
+  uint32_t chunk = atom >> ChunkShift;
+  if (chunk >= MaxChunks)
+    throw std::length_error("Name table is full");
+
+  // Chunks are never freed or moved, so names stay valid for the lifetime
+  // of the process and can be read without taking the lock
+  if (s_chunks[chunk] == nullptr)
+    s_chunks[chunk] = static_cast<NameObject *>(::operator new(sizeof(NameObject) * ChunkSize));
+
+  auto *entry = new (&s_chunks[chunk][atom & ChunkMask]) NameObject(name, atom);
+  index.atoms.emplace(entry->GetName(), atom);
+  ++index.count;
+
+  return atom;
+}
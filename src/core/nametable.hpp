@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include "objects/name.hpp"
+
+namespace ps
+{
+// Process wide table of interned names. Interning is thread-safe, looking up
+// an atom that has been handed out is lock-free.
+class NameTable
+{
+public:
+  static uint32_t Intern(std::string_view name);
+
+  static inline const NameObject &Get(uint32_t atom)
+  {
+    return s_chunks[atom >> ChunkShift][atom & ChunkMask];
+  }
+
+  static inline const std::string &GetName(uint32_t atom)
+  {
+    return Get(atom).GetName();
+  }
+
+private:
+  static constexpr uint32_t ChunkShift = 12;
+  static constexpr uint32_t ChunkSize = 1u << ChunkShift;
+  static constexpr uint32_t ChunkMask = ChunkSize - 1;
+  static constexpr uint32_t MaxChunks = 1024;
+
+  static NameObject *s_chunks[MaxChunks];
+};
+} // namespace ps
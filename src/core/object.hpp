@@ -1,15 +1,15 @@
 #pragma once
-#include <memory>
+#include <cstdint>
 
 namespace ps
 {
-enum class ObjectFlag
+enum class ObjectFlag : uint8_t
 {
     Literal,
     Executable,
 };
 
-enum class ObjectAccess
+enum class ObjectAccess : uint8_t
 {
     Unlimited,
     ReadOnly,
@@ -17,19 +17,32 @@ enum class ObjectAccess
     None,
 };
 
-enum class ObjectType
+enum class ObjectType : uint8_t
 {
     None,
     Operand,
     Name,
     Real,
     Integer,
-    String
+    String,
+    Boolean,
+    Mark,
+    Null,
+    Save,
+    Dict,
+    Array,
+    File
 };
 
-class Object : public std::enable_shared_from_this<Object>
+// Base class of all composite objects. Simple objects are stored inline
+// inside a ps::Value and never derive from this class. Composite objects are
+// allocated from a ps::VM and released by restore, not individually.
+class Object
 {
   public:
+    // Save level of objects that are never subject to save/restore
+    static constexpr uint16_t GlobalLevel = 0xFFFF;
+
     inline bool IsExecutable()
     {
         return m_flag == ObjectFlag::Executable;
@@ -45,15 +58,30 @@ class Object : public std::enable_shared_from_this<Object>
         return m_type;
     }
 
+    inline void SetAccess(ObjectAccess access)
+    {
+        m_access = access;
+    }
+
     template<class T>
-    inline std::shared_ptr<T> Cast()
+    inline T* Cast()
     {
-      return std::static_pointer_cast<T>(shared_from_this());
+      return static_cast<T*>(this);
+    }
+
+    // Number of save levels active when the object was allocated
+    inline uint16_t GetSaveLevel() const
+    {
+        return m_saveLevel;
     }
 
   protected:
     ObjectFlag m_flag = ObjectFlag::Literal;
     ObjectAccess m_access = ObjectAccess::Unlimited;
     ObjectType m_type = ObjectType::None;
+
+  private:
+    friend class VM;
+    uint16_t m_saveLevel = GlobalLevel;
 };
-} // namespace ps
\ No newline at end of file
+} // namespace ps
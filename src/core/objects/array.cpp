@@ -0,0 +1,24 @@
+#include "array.hpp"
+#include "../vm.hpp"
+
+ps::ArrayObject *ps::ArrayObject::Create(VM &vm, uint32_t length)
+{
+  auto *array = vm.New<ArrayObject>(length * sizeof(Value), nullptr, length);
+  array->m_data = reinterpret_cast<Value *>(array + 1);
+  for (uint32_t i = 0; i < length; ++i)
+    array->m_data[i] = Value(ObjectType::Null);
+  return array;
+}
+
+void ps::ArrayObject::SetCode(VM &vm, const Instruction *code)
+{
+  // The code may be newer than the array, restore has to drop it
+  vm.Journal(this, &m_code, sizeof(m_code));
+  m_code = code;
+}
+
+void ps::ArrayObject::SetNative(VM &vm, const void *native)
+{
+  vm.Journal(this, &m_native, sizeof(m_native));
+  m_native = native;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "../object.hpp"
+#include "../value.hpp"
+#include <cstdint>
+
+namespace ps
+{
+class VM;
+struct Instruction;
+
+// Backing storage of arrays and procedures. Like strings, array values are
+// (offset, length) views into an ArrayObject, so getinterval shares the
+// elements with the original array.
+class ArrayObject final : public Object
+{
+public:
+  // Allocates `length` null elements right after the object header
+  static ArrayObject *Create(VM &vm, uint32_t length);
+
+  inline ArrayObject(Value *data, uint32_t length)
+  {
+    m_data = data;
+    m_length = length;
+    m_calls = 0;
+    m_version = 0;
+    m_code = nullptr;
+    m_native = nullptr;
+    m_type = ObjectType::Array;
+  }
+
+  inline Value *GetData() const
+  {
+    return m_data;
+  }
+
+  inline uint32_t GetLength() const
+  {
+    return m_length;
+  }
+
+  // Bytecode of the elements, nullptr until the array is first executed
+  inline const Instruction *GetCode() const
+  {
+    return m_code;
+  }
+
+  void SetCode(VM &vm, const Instruction *code);
+
+  // Native code of the elements, see ps::Jit
+  inline const void *GetNative() const
+  {
+    return m_native;
+  }
+
+  void SetNative(VM &vm, const void *native);
+
+  // Counts executions of the whole array, returns the new count
+  inline uint32_t CountCall()
+  {
+    return ++m_calls;
+  }
+
+  // Changes with every Invalidate, code inlining the elements elsewhere
+  // compares it
+  inline uint32_t GetVersion() const
+  {
+    return m_version;
+  }
+
+  // Must be called whenever an element changes
+  inline void Invalidate(VM &vm)
+  {
+    if (m_code)
+      SetCode(vm, nullptr);
+    if (m_native)
+      SetNative(vm, nullptr);
+    m_calls = 0;
+    ++m_version;
+  }
+
+private:
+  Value *m_data;
+  uint32_t m_length;
+  // not journaled, it's only a heuristic
+  uint32_t m_calls;
+  // not journaled either, after a restore inlined copies are merely
+  // recompiled
+  uint32_t m_version;
+  const Instruction *m_code;
+  const void *m_native;
+};
+} // namespace ps
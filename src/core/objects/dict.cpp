@@ -0,0 +1,175 @@
+#include "dict.hpp"
+#include "../nametable.hpp"
+#include "../vm.hpp"
+#include <cstring>
+
+ps::DictObject *ps::DictObject::Create(VM &vm, uint32_t capacity)
+{
+  uint32_t slots = SlotsFor(capacity);
+  return vm.New<DictObject>(0, capacity, AllocateTable(vm, slots), slots);
+}
+
+uint32_t ps::DictObject::SlotsFor(uint32_t capacity)
+{
+  // Keep the load factor at or below 3/4, 2^31 slots are the most a
+  // uint32_t mask can address
+  uint32_t slots = 8;
+  while (slots - slots / 4 < capacity && slots < 0x80000000u)
+    slots *= 2;
+  return slots;
+}
+
+ps::DictObject::Entry *ps::DictObject::AllocateTable(VM &vm, uint32_t slots)
+{
+  auto *table = static_cast<Entry *>(vm.Allocate(sizeof(Entry) * slots, alignof(Entry)));
+  for (uint32_t i = 0; i < slots; ++i)
+    new (&table[i]) Entry();
+  return table;
+}
+
+uint32_t ps::DictObject::Hash(const Value &key)
+{
+  switch (key.GetType())
+  {
+  case ObjectType::Name:
+    return NameTable::Get(key.GetAtom()).GetHash();
+  case ObjectType::Integer:
+    return static_cast<uint32_t>(key.GetInteger()) * 2654435761u;
+  case ObjectType::Real:
+  {
+    uint32_t bits;
+    float real = key.GetReal();
+    std::memcpy(&bits, &real, sizeof(bits));
+    return bits * 2654435761u;
+  }
+  case ObjectType::Boolean:
+    return key.GetBoolean() ? 1 : 0;
+  default:
+  {
+    // Intervals of one array are different keys
+    auto ptr = reinterpret_cast<uintptr_t>(key.GetObject<Object>());
+    return (static_cast<uint32_t>(ptr >> 4) ^ key.GetOffset() ^ key.GetLength() << 16) * 2654435761u;
+  }
+  }
+}
+
+bool ps::DictObject::Equals(const Value &a, const Value &b)
+{
+  if (a.GetType() != b.GetType())
+    return false;
+
+  switch (a.GetType())
+  {
+  case ObjectType::Name:
+    return a.GetAtom() == b.GetAtom();
+  case ObjectType::Integer:
+    return a.GetInteger() == b.GetInteger();
+  case ObjectType::Real:
+    return a.GetReal() == b.GetReal();
+  case ObjectType::Boolean:
+    return a.GetBoolean() == b.GetBoolean();
+  default:
+    return a.GetObject<Object>() == b.GetObject<Object>() && a.GetOffset() == b.GetOffset() &&
+           a.GetLength() == b.GetLength();
+  }
+}
+
+ps::Value *ps::DictObject::Find(const Value &key) const
+{
+  for (uint32_t i = Hash(key) & m_mask;; i = (i + 1) & m_mask)
+  {
+    auto &entry = m_table[i];
+    if (entry.key.GetType() == ObjectType::None)
+      return nullptr;
+    if (Equals(entry.key, key))
+      return &entry.value;
+  }
+}
+
+bool ps::DictObject::Put(VM &vm, const Value &key, const Value &value)
+{
+  if (auto *existing = Find(key))
+  {
+    vm.Journal(this, existing, sizeof(Value));
+    *existing = value;
+    return false;
+  }
+
+  // Level 2 dictionaries grow instead of raising dictfull
+  if (m_length >= m_capacity)
+    Grow(vm);
+
+  uint32_t i = Hash(key) & m_mask;
+  while (m_table[i].key.GetType() != ObjectType::None)
+    i = (i + 1) & m_mask;
+
+  vm.Journal(this, &m_table[i], sizeof(Entry));
+  vm.Journal(this, &m_length, sizeof(m_length));
+  m_table[i].key = key;
+  m_table[i].value = value;
+  ++m_length;
+  return true;
+}
+
+bool ps::DictObject::Remove(VM &vm, const Value &key)
+{
+  uint32_t i = Hash(key) & m_mask;
+  for (;; i = (i + 1) & m_mask)
+  {
+    if (m_table[i].key.GetType() == ObjectType::None)
+      return false;
+    if (Equals(m_table[i].key, key))
+      break;
+  }
+
+  vm.Journal(this, &m_length, sizeof(m_length));
+  --m_length;
+
+  // Shift following entries of the probe sequence back into the hole
+  for (uint32_t j = (i + 1) & m_mask;; j = (j + 1) & m_mask)
+  {
+    auto &entry = m_table[j];
+    if (entry.key.GetType() == ObjectType::None)
+      break;
+
+    uint32_t home = Hash(entry.key) & m_mask;
+    if (((j - home) & m_mask) >= ((j - i) & m_mask))
+    {
+      vm.Journal(this, &m_table[i], sizeof(Entry));
+      m_table[i] = entry;
+      i = j;
+    }
+  }
+
+  vm.Journal(this, &m_table[i], sizeof(Entry));
+  m_table[i] = Entry();
+  return true;
+}
+
+void ps::DictObject::Grow(VM &vm)
+{
+  uint32_t capacity = m_capacity ? (m_capacity < 0x80000000u ? m_capacity * 2 : 0xFFFFFFFFu) : 8;
+  uint32_t slots = SlotsFor(capacity);
+  auto *table = AllocateTable(vm, slots);
+  uint32_t mask = slots - 1;
+
+  for (uint32_t i = 0; i <= m_mask; ++i)
+  {
+    const auto &entry = m_table[i];
+    if (entry.key.GetType() == ObjectType::None)
+      continue;
+
+    uint32_t j = Hash(entry.key) & mask;
+    while (table[j].key.GetType() != ObjectType::None)
+      j = (j + 1) & mask;
+    table[j] = entry;
+  }
+
+  // The old table stays untouched, so journaling the header is enough
+  vm.Journal(this, &m_capacity, sizeof(m_capacity));
+  vm.Journal(this, &m_mask, sizeof(m_mask));
+  vm.Journal(this, &m_table, sizeof(m_table));
+  m_capacity = capacity;
+  m_mask = mask;
+  m_table = table;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "../object.hpp"
+#include "../value.hpp"
+#include <cstdint>
+
+namespace ps
+{
+class VM;
+
+// Dictionary backed by a flat open-addressing table (linear probing with
+// backward-shift deletion), allocated from a ps::VM.
+class DictObject final : public Object
+{
+public:
+  struct Entry
+  {
+    Value key;
+    Value value;
+  };
+
+  // Largest capacity `dict` accepts, the implementation limit of the PLRM.
+  // Dictionaries still grow beyond it.
+  static constexpr uint32_t MaxCapacity = 65535;
+
+  // Creates a dictionary with room for `capacity` entries before it grows
+  static DictObject *Create(VM &vm, uint32_t capacity);
+
+  // Returns nullptr if the key isn't defined
+  Value *Find(const Value &key) const;
+  // Returns true if the key wasn't defined before
+  bool Put(VM &vm, const Value &key, const Value &value);
+  bool Remove(VM &vm, const Value &key);
+
+  inline uint32_t GetLength() const
+  {
+    return m_length;
+  }
+
+  inline uint32_t GetMaxLength() const
+  {
+    return m_capacity;
+  }
+
+  // Iteration over the slots of the table, the slots with a key of type
+  // ObjectType::None are empty
+  inline uint32_t GetSlotCount() const
+  {
+    return m_mask + 1;
+  }
+
+  inline const Entry &GetSlot(uint32_t index) const
+  {
+    return m_table[index];
+  }
+
+  static uint32_t Hash(const Value &key);
+  static bool Equals(const Value &a, const Value &b);
+
+  inline DictObject(uint32_t capacity, Entry *table, uint32_t slots)
+  {
+    m_type = ObjectType::Dict;
+    m_capacity = capacity;
+    m_length = 0;
+    m_mask = slots - 1;
+    m_table = table;
+  }
+
+private:
+  static Entry *AllocateTable(VM &vm, uint32_t slots);
+  static uint32_t SlotsFor(uint32_t capacity);
+  void Grow(VM &vm);
+
+  uint32_t m_capacity;
+  uint32_t m_length;
+  uint32_t m_mask;
+  Entry *m_table;
+};
+} // namespace ps
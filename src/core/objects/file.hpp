@@ -0,0 +1,30 @@
+#pragma once
+#include "../object.hpp"
+
+namespace ps
+{
+class Parser;
+
+// An executable file being read by the interpreter. The parser is owned by
+// whoever runs the file, the object only refers to it while it's on the
+// execution stack.
+class FileObject final : public Object
+{
+public:
+  inline explicit FileObject(Parser *parser)
+  {
+    m_parser = parser;
+    m_type = ObjectType::File;
+    m_flag = ObjectFlag::Executable;
+    m_access = ObjectAccess::ReadOnly;
+  }
+
+  inline Parser *GetParser() const
+  {
+    return m_parser;
+  }
+
+private:
+  Parser *m_parser;
+};
+} // namespace ps
@@ -1,26 +1,52 @@
 #pragma once
-#include "../object.hpp"
+#include <cstdint>
 #include <string_view>
 #include <string>
 
 namespace ps
 {
-class NameObject final : public Object
+// An interned name. Every distinct name exists exactly once in the
+// ps::NameTable and is referenced by its 32-bit atom.
+class NameObject final
 {
 public:
-  inline NameObject(std::string_view view, bool executable = true)
+  inline NameObject(std::string_view view, uint32_t atom)
   {
     m_name = view;
-    m_flag = executable ? ObjectFlag::Executable : ObjectFlag::Literal;
-    m_type = ObjectType::Name;
+    m_atom = atom;
+    m_hash = Hash(view);
   }
 
-  inline std::string &GetName()
+  inline const std::string &GetName() const
   {
     return m_name;
   }
 
+  inline uint32_t GetAtom() const
+  {
+    return m_atom;
+  }
+
+  inline uint32_t GetHash() const
+  {
+    return m_hash;
+  }
+
+  // FNV-1a
+  static inline uint32_t Hash(std::string_view view)
+  {
+    uint32_t hash = 2166136261u;
+    for (char c : view)
+    {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+
 private:
   std::string m_name;
+  uint32_t m_atom;
+  uint32_t m_hash;
 };
-} // namespace ps
\ No newline at end of file
+} // namespace ps
@@ -0,0 +1,10 @@
+#include "string.hpp"
+#include "../vm.hpp"
+
+ps::StringObject *ps::StringObject::Create(VM &vm, uint32_t length)
+{
+  auto *str = vm.New<StringObject>(length, nullptr, length);
+  str->m_data = reinterpret_cast<char *>(str + 1);
+  std::memset(str->m_data, 0, length);
+  return str;
+}
@@ -1,25 +1,47 @@
 #pragma once
 #include "../object.hpp"
+#include <cstdint>
+#include <cstring>
 #include <string_view>
-#include <string>
 
 namespace ps
 {
+class VM;
+
+// Backing storage of strings. String values are (offset, length) views into
+// a StringObject, so getinterval and friends share their storage with the
+// original string as the PLRM requires.
 class StringObject final : public Object
 {
 public:
-  inline StringObject(std::string_view value)
+  // Allocates zero-initialized storage right after the object header
+  static StringObject *Create(VM &vm, uint32_t length);
+
+  inline StringObject(char *data, uint32_t length)
   {
-    m_value = value;
+    m_data = data;
+    m_length = length;
     m_type = ObjectType::String;
   }
 
-  inline std::string &GetValue()
+  inline const char *GetData() const
+  {
+    return m_data;
+  }
+
+  // The caller has to journal the bytes it is about to change
+  inline char *GetData()
+  {
+    return m_data;
+  }
+
+  inline uint32_t GetLength() const
   {
-    return m_value;
+    return m_length;
   }
 
 private:
-  std::string m_value;
+  char *m_data;
+  uint32_t m_length;
 };
-} // namespace ps
\ No newline at end of file
+} // namespace ps
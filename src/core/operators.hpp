@@ -0,0 +1,154 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include "object.hpp"
+
+namespace ps
+{
+class Builtins;
+
+// Sets of object types accepted for an operand
+using TypeMask = uint16_t;
+
+constexpr TypeMask TypeBit(ObjectType type)
+{
+  return static_cast<TypeMask>(1u << static_cast<uint8_t>(type));
+}
+
+namespace operand
+{
+constexpr TypeMask Any = 0xFFFF;
+constexpr TypeMask Integer = TypeBit(ObjectType::Integer);
+constexpr TypeMask Number = Integer | TypeBit(ObjectType::Real);
+constexpr TypeMask Boolean = TypeBit(ObjectType::Boolean);
+constexpr TypeMask String = TypeBit(ObjectType::String);
+constexpr TypeMask Dict = TypeBit(ObjectType::Dict);
+constexpr TypeMask Save = TypeBit(ObjectType::Save);
+constexpr TypeMask Array = TypeBit(ObjectType::Array);
+constexpr TypeMask Proc = Array;
+} // namespace operand
+
+// Builtin operators, in the order of the operator table
+enum class Opcode : uint16_t
+{
+  Pop,
+  Exch,
+  Dup,
+  Copy,
+  Index,
+  Roll,
+  Clear,
+  Count,
+  Mark,
+  ClearToMark,
+  CountToMark,
+  Add,
+  Div,
+  IDiv,
+  Mod,
+  Mul,
+  Sub,
+  Neg,
+  Dict,
+  Length,
+  MaxLength,
+  Begin,
+  End,
+  Def,
+  Load,
+  Known,
+  Where,
+  Undef,
+  CurrentDict,
+  CountDictStack,
+  Save,
+  Restore,
+  String,
+  Get,
+  Put,
+  GetInterval,
+  PutInterval,
+  AnchorSearch,
+  Search,
+  Array,
+  ArrayBegin,
+  ArrayEnd,
+  ALoad,
+  AStore,
+  Exec,
+  ExecStack,
+  CountExecStack,
+  If,
+  IfElse,
+  For,
+  Repeat,
+  Loop,
+  ForAll,
+  Exit,
+  Stop,
+  Stopped,
+  Bind,
+  Cvx,
+  Cvlit,
+  XCheck,
+  // Continuations of the loop operators and stopped, scheduled on the
+  // execution stack and not entered in systemdict
+  ForContinue,
+  RepeatContinue,
+  LoopContinue,
+  ForAllContinue,
+  StoppedContinue,
+  // Number of opcodes
+  Max
+};
+
+// Static description of a builtin operator. The interpreter checks the
+// operand count and types against the signature before calling it, so the
+// implementation only has to check what the signature can't express.
+struct OperatorInfo
+{
+  static constexpr size_t MaxOperands = 6;
+  using Function = void (*)(Builtins &);
+
+  // Operands are listed bottom to top, as in the PLRM
+  constexpr OperatorInfo(Opcode opcode, std::string_view name, std::initializer_list<TypeMask> operands, Function func)
+      : opcode(opcode), name(name), func(func), operandCount(static_cast<uint8_t>(operands.size())), types{}
+  {
+    size_t i = 0;
+    for (auto type : operands)
+      types[i++] = type;
+  }
+
+  // Type mask of operand `n` counted from the top
+  constexpr TypeMask GetType(size_t n) const
+  {
+    return types[operandCount - 1 - n];
+  }
+
+  Opcode opcode;
+  std::string_view name;
+  Function func;
+  uint8_t operandCount;
+  TypeMask types[MaxOperands];
+};
+
+class Operators
+{
+public:
+  // Perfect hash lookup, returns nullptr for unknown names
+  static const OperatorInfo *Find(std::string_view name);
+  static const OperatorInfo &Get(Opcode opcode);
+
+  static const OperatorInfo *GetTable();
+  static size_t GetCount();
+
+  // Operators that schedule procedures or unwind the execution stack
+  static bool UsesExecStack(Opcode opcode);
+  // Operators that may change what names resolve to
+  static bool ChangesBindings(Opcode opcode);
+  // Operators whose results only depend on their operands
+  static bool IsPure(Opcode opcode);
+};
+} // namespace ps
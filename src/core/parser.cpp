@@ -1,97 +1,664 @@
 #include "parser.hpp"
-#include "util.hpp"
-#include "objects/integer.hpp"
-#include "objects/real.hpp"
-#include "objects/name.hpp"
-#include <string>
-#include <cctype>
+#include "interpreter.hpp"
+#include "nametable.hpp"
+#include "objects/array.hpp"
+#include "objects/string.hpp"
+#include "systemnames.hpp"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
 
-ps::Parser::Parser(std::istream &input) : m_input(input)
+ps::Parser::Parser(std::string_view input, Interpreter &interpr)
+    : m_interpr(interpr), m_vm(interpr.GetVM()), m_scanner(input)
 {
 }
 
-std::shared_ptr<ps::Object> ps::Parser::GetObject()
+ps::Parser::Parser(std::istream &input, Interpreter &interpr)
+    : m_interpr(interpr), m_vm(interpr.GetVM()), m_buffer(input), m_scanner(m_buffer.GetData())
 {
-  m_buffer.clear();
-  char c = 0;
-  Mode m = Mode::None;
-  bool finished = false;
-  std::shared_ptr<Object> result;
+}
 
-  while (!finished && m_input.get(c))
+bool ps::Parser::GetObject(Value &result)
+{
+  // Procedures are collected without recursion, the elements of all open
+  // levels share one vector
+  for (;;)
   {
-    //just skip any of these
-    if ((c == '\r') || (c== '\t'))
-      continue;
-
-    //Skip any comments
-    if (m == Mode::Comment)
+    switch (ReadToken(result))
+    {
+    case Token::Object:
+      if (m_procStarts.empty())
+        return true;
+      m_procValues.push_back(result);
+      break;
+    case Token::ProcBegin:
+      m_procStarts.push_back(m_procValues.size());
+      break;
+    case Token::ProcEnd:
     {
-      if (isNewline(c))
-        m = Mode::None;
+      if (m_procStarts.empty())
+      {
+        m_error = Error::SyntaxError;
+        return false;
+      }
 
-      continue;
+      size_t start = m_procStarts.back();
+      size_t length = m_procValues.size() - start;
+      m_procStarts.pop_back();
+      if (length > 65535)
+      {
+        m_error = Error::LimitCheck;
+        return false;
+      }
+
+      auto *proc = ArrayObject::Create(m_vm, static_cast<uint32_t>(length));
+      std::copy(m_procValues.begin() + start, m_procValues.end(), proc->GetData());
+      m_procValues.resize(start);
+      result = Value::Array(proc, 0, static_cast<uint32_t>(length));
+      result.SetExecutable(true);
+
+      if (m_procStarts.empty())
+        return true;
+      m_procValues.push_back(result);
+      break;
+    }
+    case Token::End:
+      if (!m_procStarts.empty())
+        m_error = Error::SyntaxError;
+      return false;
+    case Token::Error:
+      if (m_error == Error::None)
+        m_error = Error::SyntaxError;
+      return false;
     }
+  }
+}
 
-    //Handle delimitters
-    if (isWhitespace(c) || isNewline(c))
-    {
-      if (m != Mode::None)
-        finished = true;
+ps::Parser::Token ps::Parser::ReadToken(Value &result)
+{
+  if (!m_pending.empty())
+  {
+    result = m_pending.back();
+    m_pending.pop_back();
+    return Token::Object;
+  }
+
+  auto token = m_scanner.Next();
+  switch (token.type)
+  {
+  case Scanner::TokenType::Regular:
+    if (!ParseNumber(token.text, result))
+      result = Value::Name(NameTable::Intern(token.text));
+    return m_error == Error::None ? Token::Object : Token::Error;
+  case Scanner::TokenType::LiteralName:
+    result = Value::Name(NameTable::Intern(token.text), false);
+    return Token::Object;
+  case Scanner::TokenType::ImmediateName:
+    return LookupImmediate(Value::Name(NameTable::Intern(token.text)), result) ? Token::Object : Token::Error;
+  case Scanner::TokenType::ProcBegin:
+    return Token::ProcBegin;
+  case Scanner::TokenType::ProcEnd:
+    return Token::ProcEnd;
+  case Scanner::TokenType::String:
+    return DecodeString(token.text) ? MakeString(result) : Token::Error;
+  case Scanner::TokenType::HexString:
+    return DecodeHex(token.text) ? MakeString(result) : Token::Error;
+  case Scanner::TokenType::Ascii85String:
+    return DecodeAscii85(token.text) ? MakeString(result) : Token::Error;
+  case Scanner::TokenType::Binary:
+    return ReadBinary(token.text, result);
+  case Scanner::TokenType::Invalid:
+    return Token::Error;
+  case Scanner::TokenType::End:
+    break;
+  }
+  return Token::End;
+}
+
+ps::Parser::Token ps::Parser::MakeString(Value &result)
+{
+  if (m_decoded.size() > 65535)
+  {
+    m_error = Error::LimitCheck;
+    return Token::Error;
+  }
 
+  auto length = static_cast<uint32_t>(m_decoded.size());
+  auto *str = StringObject::Create(m_vm, length);
+  std::memcpy(str->GetData(), m_decoded.data(), length);
+  result = Value::String(str, 0, length);
+  return Token::Object;
+}
+
+bool ps::Parser::DecodeString(std::string_view text)
+{
+  m_decoded.clear();
+  for (size_t i = 0; i < text.size(); ++i)
+  {
+    char c = text[i];
+    if (c == '\r')
+    {
+      // Any end of line reads as \n
+      if (i + 1 < text.size() && text[i + 1] == '\n')
+        ++i;
+      m_decoded += '\n';
       continue;
     }
-
-    //Go into comment mode
-    if (m != Mode::String && isComment(c))
+    if (c != '\\')
     {
-      m = Mode::Comment;
+      m_decoded += c;
       continue;
     }
 
-    //Store the character
-    m_buffer += c;
-
-    //Handle any transitions
-    switch (m)
+    if (++i == text.size())
+      break;
+    c = text[i];
+    switch (c)
     {
-    case Mode::None:
-      if (std::isdigit(c) || isSign(c))
-        m = Mode::Integer;
-      else
-        m = Mode::Name;
+    case 'n':
+      m_decoded += '\n';
+      break;
+    case 'r':
+      m_decoded += '\r';
+      break;
+    case 't':
+      m_decoded += '\t';
       break;
-    case Mode::Integer:
-      if (c == 'E' || c == '.')
-        m = Mode::Real;
-      else if (!std::isdigit(c))
-        m = Mode::Name;
+    case 'b':
+      m_decoded += '\b';
       break;
-    case Mode::Real:
-      if (c == 'E' || c == '.')
-        m = Mode::Name;
+    case 'f':
+      m_decoded += '\f';
       break;
-    case Mode::String:
+    case '\r':
+      // Line continuation
+      if (i + 1 < text.size() && text[i + 1] == '\n')
+        ++i;
       break;
-    case Mode::Array:
+    case '\n':
       break;
     default:
+      if (c >= '0' && c <= '7')
+      {
+        int code = c - '0';
+        for (int digits = 1; digits < 3 && i + 1 < text.size() && text[i + 1] >= '0' && text[i + 1] <= '7'; ++digits)
+          code = code * 8 + (text[++i] - '0');
+        m_decoded += static_cast<char>(code);
+      }
+      else
+        // \\, \(, \) and unknown escapes stand for the character itself
+        m_decoded += c;
       break;
     }
   }
+  return true;
+}
+
+bool ps::Parser::DecodeHex(std::string_view text)
+{
+  m_decoded.clear();
+  int high = -1;
+  for (char c : text)
+  {
+    int digit;
+    if (c >= '0' && c <= '9')
+      digit = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      digit = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      digit = c - 'A' + 10;
+    else if (Scanner::IsWhitespace(c))
+      continue;
+    else
+      return false;
+
+    if (high < 0)
+      high = digit;
+    else
+    {
+      m_decoded += static_cast<char>(high << 4 | digit);
+      high = -1;
+    }
+  }
+
+  // An odd digit count reads as if a 0 followed
+  if (high >= 0)
+    m_decoded += static_cast<char>(high << 4);
+  return true;
+}
+
+bool ps::Parser::DecodeAscii85(std::string_view text)
+{
+  m_decoded.clear();
+  uint32_t group = 0;
+  int count = 0;
+  for (char c : text)
+  {
+    if (Scanner::IsWhitespace(c))
+      continue;
+    if (c == 'z' && count == 0)
+    {
+      m_decoded.append(4, '\0');
+      continue;
+    }
+    if (c < '!' || c > 'u')
+      return false;
+
+    uint64_t next = uint64_t(group) * 85 + static_cast<uint32_t>(c - '!');
+    if (next > UINT32_MAX)
+      return false;
+    group = static_cast<uint32_t>(next);
+    if (++count == 5)
+    {
+      for (int shift = 24; shift >= 0; shift -= 8)
+        m_decoded += static_cast<char>(group >> shift);
+      group = 0;
+      count = 0;
+    }
+  }
+
+  // A final partial group of n characters encodes n - 1 bytes, it's
+  // padded with the highest digit
+  if (count == 1)
+    return false;
+  if (count > 0)
+  {
+    uint64_t padded = group;
+    for (int i = count; i < 5; ++i)
+      padded = padded * 85 + 84;
+    for (int i = 0; i < count - 1; ++i)
+      m_decoded += static_cast<char>(padded >> (24 - 8 * i));
+  }
+  return true;
+}
+
+bool ps::Parser::ParseNumber(std::string_view text, Value &result)
+{
+  const char *p = text.data();
+  const char *end = p + text.size();
+  const char *start = p;
+  bool negative = false;
+  if (p != end && (*p == '+' || *p == '-'))
+  {
+    // from_chars only takes a minus
+    negative = *p++ == '-';
+    if (!negative)
+      start = p;
+  }
+
+  // Anything above 2^32 doesn't fit either way, accumulation stops there
+  constexpr uint64_t Limit = uint64_t(1) << 32;
+  const char *digits = p;
+  uint64_t value = 0;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p)
+    value = std::min(value * 10 + static_cast<unsigned>(*p - '0'), Limit);
+  bool integral = p != digits;
 
-  switch (m)
+  if (p == end && integral)
   {
-  case Mode::Name:
-    result = std::make_shared<NameObject>(m_buffer);
+    // Integers that don't fit are promoted to reals
+    if (value <= (negative ? uint64_t(INT_MAX) + 1 : uint64_t(INT_MAX)))
+    {
+      result = Value(static_cast<int>(negative ? 0 - value : value));
+      return true;
+    }
+  }
+  else if (p != end && *p == '#')
+  {
+    // base#digits, the digits are the bits of a 32-bit integer
+    if (digits != text.data() || !integral || value < 2 || value > 36)
+      return false;
+    auto base = static_cast<unsigned>(value);
+    value = 0;
+    digits = ++p;
+    for (; p != end; ++p)
+    {
+      char c = *p;
+      unsigned digit = c >= '0' && c <= '9'   ? c - '0'
+                       : c >= 'a' && c <= 'z' ? c - 'a' + 10
+                       : c >= 'A' && c <= 'Z' ? c - 'A' + 10
+                                              : 36;
+      if (digit >= base)
+        return false;
+      value = std::min(value * base + digit, Limit);
+    }
+    if (p == digits)
+      return false;
+    if (value < Limit)
+      result = Value(static_cast<int>(static_cast<uint32_t>(value)));
+    else
+      result = Value(static_cast<float>(value));
+    return true;
+  }
+  else
+  {
+    // [digits][.digits][(e|E)[sign]digits], with a digit somewhere before
+    // the exponent
+    if (p != end && *p == '.')
+    {
+      const char *fraction = ++p;
+      while (p != end && *p >= '0' && *p <= '9')
+        ++p;
+      integral = integral || p != fraction;
+    }
+    if (!integral)
+      return false;
+    if (p != end && (*p == 'e' || *p == 'E'))
+    {
+      if (++p != end && (*p == '+' || *p == '-'))
+        ++p;
+      const char *exponent = p;
+      while (p != end && *p >= '0' && *p <= '9')
+        ++p;
+      if (p == exponent)
+        return false;
+    }
+    if (p != end)
+      return false;
+  }
+
+  // from_chars is out of range both ways. Overflows are a limitcheck,
+  // reals too small for a float become denormals or zero.
+  float real = 0;
+  auto parsed = std::from_chars(start, end, real);
+  if (parsed.ec == std::errc::result_out_of_range)
+  {
+    if (GetMagnitude(text) > 0)
+      m_error = Error::LimitCheck;
+    else
+    {
+      double small = 0;
+      std::from_chars(start, end, small);
+      real = static_cast<float>(small);
+    }
+  }
+  result = Value(real);
+  return true;
+}
+
+long ps::Parser::GetMagnitude(std::string_view real)
+{
+  size_t i = 0;
+  if (i < real.size() && (real[i] == '+' || real[i] == '-'))
+    ++i;
+
+  // Integral digits from the first nonzero one count up, leading zeros of
+  // the fraction count down
+  long magnitude = -1;
+  bool leading = true;
+  bool fraction = false;
+  for (; i < real.size() && real[i] != 'e' && real[i] != 'E'; ++i)
+  {
+    if (real[i] == '.')
+      fraction = true;
+    else if (leading && real[i] == '0')
+      magnitude -= fraction;
+    else
+    {
+      leading = false;
+      magnitude += !fraction;
+    }
+  }
+
+  // The exponent saturates far beyond any float
+  long exponent = 0;
+  bool negative = false;
+  if (++i < real.size() && (real[i] == '+' || real[i] == '-'))
+    negative = real[i++] == '-';
+  for (; i < real.size(); ++i)
+    exponent = std::min(exponent * 10 + (real[i] - '0'), 100000L);
+  return magnitude + (negative ? -exponent : exponent);
+}
+
+ps::Parser::Token ps::Parser::ReadBinary(std::string_view text, Value &result)
+{
+  auto code = static_cast<unsigned char>(text[0]);
+  const char *p = text.data() + 1;
+  switch (code)
+  {
+  case 128:
+  case 129:
+  case 130:
+  case 131:
+    return ReadObjectSequence(text, result);
+  case 132:
+  case 133:
+    result = Value(static_cast<int32_t>(Scanner::ReadUnsigned(p, 4, code == 133)));
+    return Token::Object;
+  case 134:
+  case 135:
+    result = Value(static_cast<int>(static_cast<int16_t>(Scanner::ReadUnsigned(p, 2, code == 135))));
+    return Token::Object;
+  case 136:
+    result = Value(static_cast<int>(static_cast<signed char>(*p)));
+    return Token::Object;
+  case 137:
+    result = ReadNumber(p + 1, static_cast<unsigned char>(*p));
+    return Token::Object;
+  case 138:
+  case 139:
+    result = ReadNumber(p, code == 138 ? 48 : 48 + 128);
+    return Token::Object;
+  case 140:
+    result = ReadNumber(p, 49);
+    return Token::Object;
+  case 141:
+    result = Value(*p != 0);
+    return Token::Object;
+  case 142:
+    m_decoded.assign(p + 1, text.size() - 2);
+    return MakeString(result);
+  case 143:
+  case 144:
+    m_decoded.assign(p + 2, text.size() - 3);
+    return MakeString(result);
+  case 145:
+  case 146:
+    return MakeSystemName(static_cast<unsigned char>(*p), code == 146, result) ? Token::Object : Token::Error;
+  case 149:
+  {
+    // Homogeneous number arrays are decoded straight into the elements
+    auto r = static_cast<unsigned char>(*p);
+    auto size = Scanner::GetNumberSize(r);
+    auto length = Scanner::ReadUnsigned(p + 1, 2, r & 128);
+    auto *array = ArrayObject::Create(m_vm, length);
+    auto *elements = array->GetData();
+    for (uint32_t i = 0; i < length; ++i)
+      elements[i] = ReadNumber(p + 3 + i * size, r);
+    result = Value::Array(array, 0, length);
+    return Token::Object;
+  }
+  default:
+    // User names (147 and 148) need defineusername
+    m_error = Error::Undefined;
+    return Token::Error;
+  }
+}
+
+ps::Parser::Token ps::Parser::ReadObjectSequence(std::string_view text, Value &result)
+{
+  bool lowFirst = static_cast<unsigned char>(text[0]) & 1;
+  size_t header = text[1] != 0 ? 4 : 8;
+  if (text.size() < header)
+    return Token::Error;
+  size_t count = text[1] != 0 ? static_cast<unsigned char>(text[1]) : Scanner::ReadUnsigned(text.data() + 2, 2, lowFirst);
+
+  // Offsets in the objects are relative to the first top-level object
+  auto objects = text.substr(header);
+  if (count * 8 > objects.size())
+    return Token::Error;
+  size_t budget = objects.size() / 8;
+
+  // The sequence is an executable array. Read by the interpreter that's
+  // the same as reading its elements one after the other, unless it's
+  // inside a procedure.
+  auto *array = ArrayObject::Create(m_vm, static_cast<uint32_t>(count));
+  auto *elements = array->GetData();
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (!DecodeSequenceObject(objects, i * 8, lowFirst, 0, budget, elements[i]))
+      return Token::Error;
+  }
+
+  if (m_procStarts.empty())
+  {
+    m_pending.assign(std::make_reverse_iterator(elements + count), std::make_reverse_iterator(elements));
+    return ReadToken(result);
+  }
+  result = Value::Array(array, 0, static_cast<uint32_t>(count));
+  result.SetExecutable(true);
+  return Token::Object;
+}
+
+bool ps::Parser::DecodeSequenceObject(std::string_view objects, size_t offset, bool lowFirst, size_t depth,
+                                      size_t &budget, Value &result)
+{
+  if (budget == 0 || offset + 8 > objects.size())
+    return false;
+  if (depth > 64)
+  {
+    m_error = Error::LimitCheck;
+    return false;
+  }
+  --budget;
+
+  const char *object = objects.data() + offset;
+  auto type = static_cast<unsigned char>(object[0]);
+  bool executable = type & 128;
+  auto length = Scanner::ReadUnsigned(object + 2, 2, lowFirst);
+  auto value = Scanner::ReadUnsigned(object + 4, 4, lowFirst);
+  switch (type & 127)
+  {
+  case 0:
+    result = Value(ObjectType::Null);
+    break;
+  case 1:
+    result = Value(static_cast<int32_t>(value));
+    break;
+  case 2:
+    // IEEE, or fixed point with the length as the scale
+    if (length >= 32)
+      return false;
+    result = ReadNumber(object + 4, static_cast<unsigned char>((length == 0 ? 48 : length) | (lowFirst ? 128 : 0)));
+    break;
+  case 3:
+  case 6:
+    if (length == 0)
+    {
+      if (!MakeSystemName(value, executable, result))
+        return false;
+    }
+    else if (length == 0xFFFF)
+    {
+      // User names need defineusername
+      m_error = Error::Undefined;
+      return false;
+    }
+    else if (value + size_t(length) > objects.size())
+      return false;
+    else
+      result = Value::Name(NameTable::Intern(objects.substr(value, length)), executable);
+    // Immediately evaluated names are replaced like //name
+    return (type & 127) == 3 || LookupImmediate(result, result);
+  case 4:
+    result = Value(value != 0);
+    break;
+  case 5:
+  {
+    if (value + size_t(length) > objects.size())
+      return false;
+    auto *str = StringObject::Create(m_vm, length);
+    std::memcpy(str->GetData(), objects.data() + value, length);
+    result = Value::String(str, 0, length);
     break;
-  case Mode::Integer:
-    result = std::make_shared<IntegerObject>(std::stoi(m_buffer));
+  }
+  case 9:
+  {
+    if (value + size_t(length) * 8 > objects.size())
+      return false;
+    auto *array = ArrayObject::Create(m_vm, length);
+    auto *elements = array->GetData();
+    for (uint32_t i = 0; i < length; ++i)
+    {
+      if (!DecodeSequenceObject(objects, value + i * 8, lowFirst, depth + 1, budget, elements[i]))
+        return false;
+    }
+    result = Value::Array(array, 0, length);
     break;
-  case Mode::Real:
-    result = std::make_shared<RealObject>(std::stof(m_buffer));
+  }
+  case 10:
+    result = Value(ObjectType::Mark);
     break;
+  default:
+    return false;
   }
 
-  return result;
-}
\ No newline at end of file
+  result.SetExecutable(executable);
+  return true;
+}
+
+bool ps::Parser::MakeSystemName(uint32_t index, bool executable, Value &result)
+{
+  if (index >= SystemNameCount)
+  {
+    m_error = Error::Undefined;
+    return false;
+  }
+  result = Value::Name(NameTable::Intern(SystemNames[index]), executable);
+  return true;
+}
+
+bool ps::Parser::LookupImmediate(const Value &name, Value &result)
+{
+  auto *value = m_interpr.DictLookup(name);
+  if (value == nullptr)
+  {
+    m_error = Error::Undefined;
+    return false;
+  }
+  result = *value;
+  return true;
+}
+
+ps::Value ps::Parser::ReadNumber(const char *p, unsigned char r)
+{
+  bool lowFirst = r & 128;
+  r &= 127;
+
+  // Fixed point numbers with a scale of 0 are integers
+  int32_t fixed;
+  unsigned scale;
+  if (r < 32)
+  {
+    fixed = static_cast<int32_t>(Scanner::ReadUnsigned(p, 4, lowFirst));
+    scale = r;
+  }
+  else if (r < 48)
+  {
+    fixed = static_cast<int16_t>(Scanner::ReadUnsigned(p, 2, lowFirst));
+    scale = r - 32u;
+  }
+  else if (r < 50)
+  {
+    // Native reals are IEEE on everything we run on
+    float real;
+    if (r == 48)
+    {
+      uint32_t bits = Scanner::ReadUnsigned(p, 4, lowFirst);
+      std::memcpy(&real, &bits, sizeof(real));
+    }
+    else
+      std::memcpy(&real, p, sizeof(real));
+    return Value(real);
+  }
+  else
+    return Value();
+
+  if (scale == 0)
+    return Value(static_cast<int>(fixed));
+  return Value(std::ldexp(static_cast<float>(fixed), -static_cast<int>(scale)));
+}
@@ -1,60 +1,108 @@
 #pragma once
 #include <istream>
+#include <string>
+#include <string_view>
 #include <vector>
-#include <memory>
-#include "object.hpp"
+#include "error.hpp"
+#include "inputbuffer.hpp"
+#include "scanner.hpp"
+#include "value.hpp"
 
 namespace ps
 {
+class Interpreter;
+class VM;
 
+// Turns program text into objects. Tokens come from a ps::Scanner over one
+// contiguous span, names are interned straight from it.
 class Parser
 {
 public:
-  enum Error
-  {
-    LimitCheck = 0,
-  };
-
-  Parser(std::istream &input);
-
-  std::shared_ptr<Object> GetObject();
+  // Objects are allocated in the interpreter's VM and //names are looked
+  // up in its dictionaries. `input` has to outlive the parser.
+  Parser(std::string_view input, Interpreter &interpr);
+  // Reads the whole stream into a buffer the parser owns
+  Parser(std::istream &input, Interpreter &interpr);
 
-private:
-  enum class Mode
-  {
-    None,
-    Integer,
-    String,
-    Real,
-    Name,
-    Array,
-    Comment,
-    Error
-  };
+  // Reads the next object, returns false at the end of the input or on a
+  // syntax error
+  bool GetObject(Value &result);
 
-  inline bool isComment(const char c) const
+  // Set when GetObject failed before the end of the input
+  inline Error GetError() const
   {
-    return c == '%';
+    return m_error;
   }
 
-  inline bool isNewline(const char c) const
+  // Where the next token starts in the input. Objects left of a binary
+  // object sequence come first, they're already past it.
+  inline size_t GetOffset() const
   {
-    return c == '\n';
+    return m_scanner.GetOffset();
   }
 
-  inline bool isWhitespace(const char c) const
+  inline bool HasPending() const
   {
-    return c == ' ';
+    return !m_pending.empty();
   }
 
-  inline bool isSign(const char c) const
+private:
+  enum class Token
   {
-    return c == '+' || c == '-';
-  }
+    Object,
+    ProcBegin,
+    ProcEnd,
+    End,
+    // Malformed input, or a string that's too long
+    Error
+  };
+
+  Token ReadToken(Value &result);
+  // Makes a string object of m_decoded
+  Token MakeString(Value &result);
+
+  // Fill m_decoded with the contents of a string token, false if it's
+  // malformed
+  bool DecodeString(std::string_view text);
+  bool DecodeHex(std::string_view text);
+  bool DecodeAscii85(std::string_view text);
+
+  // Binary tokens and binary object sequences, PLRM 3.14. The text starts
+  // with the token byte and has the length the scanner measured.
+  Token ReadBinary(std::string_view text, Value &result);
+  Token ReadObjectSequence(std::string_view text, Value &result);
+  // The object at `offset` into the objects of a sequence. Each decoded
+  // object uses up one of `budget`, so malformed offsets can't loop.
+  bool DecodeSequenceObject(std::string_view objects, size_t offset, bool lowFirst, size_t depth, size_t &budget,
+                            Value &result);
+  bool MakeSystemName(uint32_t index, bool executable, Value &result);
+  // The current value of an immediately evaluated name, undefined if
+  // there's none
+  bool LookupImmediate(const Value &name, Value &result);
+  // A number in binary representation `r`, see Scanner::GetNumberSize
+  static Value ReadNumber(const char *p, unsigned char r);
+
+  // Integers, radix numbers and reals in one pass, false for anything
+  // else. Reals beyond the float range set m_error.
+  bool ParseNumber(std::string_view text, Value &result);
+  // Decimal exponent of a real's leading digit, positive for reals out of
+  // range by being too large
+  static long GetMagnitude(std::string_view real);
 
 private:
-  std::istream &m_input;
-  std::string m_buffer;
-  Error m_err;
+  Interpreter &m_interpr;
+  VM &m_vm;
+  InputBuffer m_buffer;
+  Scanner m_scanner;
+  // Elements of the procedures being read, m_procStarts holds where each
+  // nesting level begins
+  std::vector<Value> m_procValues;
+  std::vector<size_t> m_procStarts;
+  // Scratch space for string tokens, kept to avoid allocations
+  std::string m_decoded;
+  // Top-level objects of a binary object sequence still to be returned,
+  // the next one last
+  std::vector<Value> m_pending;
+  Error m_error = Error::None;
 };
-} // namespace ps
\ No newline at end of file
+} // namespace ps
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ps
+{
+// Minimal perfect hash over a fixed set of strings, built at compile time
+// with the hash-and-displace scheme: keys are grouped into buckets by a
+// first hash, then every bucket gets a seed for a second hash that places
+// all of its keys into free slots.
+template <size_t N>
+class PerfectHash
+{
+public:
+  static constexpr size_t BucketCount = (N + 3) / 4;
+  static constexpr size_t SlotCount = [] {
+    size_t slots = 1;
+    while (slots < N + N / 4)
+      slots *= 2;
+    return slots;
+  }();
+
+  template <class T>
+  constexpr PerfectHash(const T (&entries)[N], std::string_view T::*key) : m_seeds{}, m_slots{}
+  {
+    size_t bucketOf[N] = {};
+    size_t sizes[BucketCount] = {};
+    for (size_t i = 0; i < N; ++i)
+    {
+      bucketOf[i] = Hash(entries[i].*key, 0) % BucketCount;
+      ++sizes[bucketOf[i]];
+    }
+
+    // Place large buckets first while most slots are still free
+    size_t order[BucketCount] = {};
+    for (size_t i = 0; i < BucketCount; ++i)
+      order[i] = i;
+    for (size_t i = 0; i < BucketCount; ++i)
+      for (size_t j = i + 1; j < BucketCount; ++j)
+        if (sizes[order[j]] > sizes[order[i]])
+        {
+          size_t tmp = order[i];
+          order[i] = order[j];
+          order[j] = tmp;
+        }
+
+    for (size_t b = 0; b < BucketCount && sizes[order[b]] > 0; ++b)
+    {
+      size_t bucket = order[b];
+      for (uint32_t seed = 1;; ++seed)
+      {
+        if (seed > 1000000)
+          throw "No perfect hash seed found";
+
+        bool fits = true;
+        size_t placed[N] = {};
+        size_t count = 0;
+        for (size_t i = 0; i < N && fits; ++i)
+        {
+          if (bucketOf[i] != bucket)
+            continue;
+          size_t slot = Hash(entries[i].*key, seed) & (SlotCount - 1);
+          fits = m_slots[slot] == 0;
+          for (size_t k = 0; k < count && fits; ++k)
+            fits = placed[k] != slot;
+          placed[count++] = slot;
+        }
+
+        if (!fits)
+          continue;
+
+        size_t k = 0;
+        for (size_t i = 0; i < N; ++i)
+          if (bucketOf[i] == bucket)
+            m_slots[placed[k++]] = static_cast<uint16_t>(i + 1);
+        m_seeds[bucket] = seed;
+        break;
+      }
+    }
+  }
+
+  // Index of the entry that may match `key`, the caller compares the key.
+  // Returns -1 if no entry can match.
+  constexpr int Find(std::string_view key) const
+  {
+    uint32_t seed = m_seeds[Hash(key, 0) % BucketCount];
+    uint16_t slot = m_slots[Hash(key, seed) & (SlotCount - 1)];
+    return static_cast<int>(slot) - 1;
+  }
+
+  static constexpr uint32_t Hash(std::string_view key, uint32_t seed)
+  {
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (char c : key)
+    {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 16777619u;
+    }
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    hash ^= hash >> 12;
+    return hash;
+  }
+
+private:
+  uint32_t m_seeds[BucketCount];
+  uint16_t m_slots[SlotCount];
+};
+} // namespace ps
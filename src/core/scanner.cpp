@@ -0,0 +1,375 @@
+#include "scanner.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PS_SCANNER_SIMD 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PS_SCANNER_SIMD 1
+#else
+#define PS_SCANNER_SIMD 0
+#endif
+
+#if PS_SCANNER_SIMD && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+#if PS_SCANNER_SIMD
+#if defined(__AVX2__)
+using Block = __m256i;
+constexpr size_t BlockSize = 32;
+constexpr uint32_t BlockMask = 0xFFFFFFFF;
+
+inline Block LoadBlock(const char *p)
+{
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+inline Block ZeroBlock()
+{
+  return _mm256_setzero_si256();
+}
+
+inline Block Equal(Block block, char c)
+{
+  return _mm256_cmpeq_epi8(block, _mm256_set1_epi8(c));
+}
+
+inline Block Or(Block a, Block b)
+{
+  return _mm256_or_si256(a, b);
+}
+
+inline uint32_t Bits(Block block)
+{
+  return static_cast<uint32_t>(_mm256_movemask_epi8(block));
+}
+#else
+using Block = __m128i;
+constexpr size_t BlockSize = 16;
+constexpr uint32_t BlockMask = 0xFFFF;
+
+inline Block LoadBlock(const char *p)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+inline Block ZeroBlock()
+{
+  return _mm_setzero_si128();
+}
+
+inline Block Equal(Block block, char c)
+{
+  return _mm_cmpeq_epi8(block, _mm_set1_epi8(c));
+}
+
+inline Block Or(Block a, Block b)
+{
+  return _mm_or_si128(a, b);
+}
+
+inline uint32_t Bits(Block block)
+{
+  return static_cast<uint32_t>(_mm_movemask_epi8(block));
+}
+#endif
+
+inline unsigned FirstBit(uint32_t bits)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, bits);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(bits));
+#endif
+}
+#endif
+
+// A character class, matched with one table lookup per character or a
+// vector compare per listed character
+template <char... Chars>
+struct CharSet
+{
+  static constexpr bool Contains(char c)
+  {
+    return ((c == Chars) || ...);
+  }
+
+#if PS_SCANNER_SIMD
+  static inline Block Match(Block block)
+  {
+    Block result = ZeroBlock();
+    ((result = Or(result, Equal(block, Chars))), ...);
+    return result;
+  }
+#endif
+};
+
+template <typename First, typename Second>
+struct Union
+{
+  static constexpr bool Contains(char c)
+  {
+    return First::Contains(c) || Second::Contains(c);
+  }
+
+#if PS_SCANNER_SIMD
+  static inline Block Match(Block block)
+  {
+    return Or(First::Match(block), Second::Match(block));
+  }
+#endif
+};
+
+// PLRM 3.2.2
+using Whitespace = CharSet<' ', '\n', '\r', '\t', '\f', '\0'>;
+using Delimiters = CharSet<'(', ')', '<', '>', '[', ']', '{', '}', '/', '%'>;
+// Bytes 128 to 159, they start binary tokens
+struct BinaryTokens
+{
+  static constexpr bool Contains(char c)
+  {
+    return static_cast<unsigned char>(c) >= 128 && static_cast<unsigned char>(c) < 160;
+  }
+
+#if PS_SCANNER_SIMD
+  // As signed bytes that's -128 to -97
+  static inline Block Match(Block block)
+  {
+#if defined(__AVX2__)
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(-96), block);
+#else
+    return _mm_cmplt_epi8(block, _mm_set1_epi8(-96));
+#endif
+  }
+#endif
+};
+
+using Separators = Union<Union<Whitespace, Delimiters>, BinaryTokens>;
+// Comments run up to one of these
+using LineEnds = CharSet<'\n', '\r', '\f'>;
+// Characters that matter inside a (string)
+using StringSpecials = CharSet<'(', ')', '\\'>;
+
+template <typename Set>
+constexpr std::array<bool, 256> Table = [] {
+  std::array<bool, 256> table{};
+  for (size_t c = 0; c < table.size(); ++c)
+    table[c] = Set::Contains(static_cast<char>(c));
+  return table;
+}();
+
+template <typename Set>
+inline bool Contains(char c)
+{
+  return Table<Set>[static_cast<uint8_t>(c)];
+}
+
+// First character at or after `pos` that is in `Set`, or with `Skip` the
+// first one that isn't. Whole blocks are classified at once while there's
+// enough input left.
+template <typename Set, bool Skip = false>
+const char *Find(const char *pos, const char *end)
+{
+#if PS_SCANNER_SIMD
+  while (static_cast<size_t>(end - pos) >= BlockSize)
+  {
+    uint32_t bits = Bits(Set::Match(LoadBlock(pos)));
+    if (Skip)
+      bits ^= BlockMask;
+    if (bits)
+      return pos + FirstBit(bits);
+    pos += BlockSize;
+  }
+#endif
+
+  while (pos != end && Contains<Set>(*pos) == Skip)
+    ++pos;
+  return pos;
+}
+} // namespace
+
+bool ps::Scanner::IsWhitespace(char c)
+{
+  return Contains<Whitespace>(c);
+}
+
+bool ps::Scanner::IsDelimiter(char c)
+{
+  return Contains<Delimiters>(c);
+}
+
+ps::Scanner::Token ps::Scanner::Next()
+{
+  // Whitespace and comments between tokens
+  for (;;)
+  {
+    m_pos = Find<Whitespace, true>(m_pos, m_end);
+    if (m_pos == m_end)
+      return {TokenType::End, {}};
+    if (*m_pos != '%')
+      break;
+    m_pos = Find<LineEnds>(m_pos, m_end);
+  }
+
+  const char *start = m_pos++;
+  if (IsBinaryToken(*start))
+    return ReadBinary();
+
+  auto type = TokenType::Regular;
+  switch (*start)
+  {
+  case '{':
+    return {TokenType::ProcBegin, std::string_view(start, 1)};
+  case '}':
+    return {TokenType::ProcEnd, std::string_view(start, 1)};
+  case '[':
+  case ']':
+    return {TokenType::Regular, std::string_view(start, 1)};
+  case '(':
+    return ReadString();
+  case ')':
+    return {TokenType::Invalid, std::string_view(start, 1)};
+  case '<':
+    if (m_pos != m_end && *m_pos == '<')
+      return {TokenType::Regular, std::string_view(start, ++m_pos - start)};
+    if (m_pos != m_end && *m_pos == '~')
+    {
+      ++m_pos;
+      return ReadEnclosed(TokenType::Ascii85String, "~>");
+    }
+    return ReadEnclosed(TokenType::HexString, ">");
+  case '>':
+    if (m_pos != m_end && *m_pos == '>')
+      return {TokenType::Regular, std::string_view(start, ++m_pos - start)};
+    return {TokenType::Invalid, std::string_view(start, 1)};
+  case '/':
+    type = TokenType::LiteralName;
+    if (m_pos != m_end && *m_pos == '/')
+    {
+      type = TokenType::ImmediateName;
+      ++m_pos;
+    }
+    start = m_pos;
+    break;
+  default:
+    break;
+  }
+
+  m_pos = Find<Separators>(m_pos, m_end);
+  return {type, std::string_view(start, static_cast<size_t>(m_pos - start))};
+}
+
+ps::Scanner::Token ps::Scanner::ReadString()
+{
+  // Balanced parentheses don't need escaping
+  const char *start = m_pos;
+  size_t depth = 1;
+  for (;;)
+  {
+    m_pos = Find<StringSpecials>(m_pos, m_end);
+    if (m_pos == m_end)
+      return {TokenType::Invalid, std::string_view(start - 1, static_cast<size_t>(m_end - start) + 1)};
+
+    switch (*m_pos++)
+    {
+    case '\\':
+      if (m_pos != m_end)
+        ++m_pos;
+      break;
+    case '(':
+      ++depth;
+      break;
+    default:
+      if (--depth == 0)
+        return {TokenType::String, std::string_view(start, static_cast<size_t>(m_pos - 1 - start))};
+      break;
+    }
+  }
+}
+
+ps::Scanner::Token ps::Scanner::ReadEnclosed(TokenType type, std::string_view terminator)
+{
+  std::string_view rest(m_pos, static_cast<size_t>(m_end - m_pos));
+  auto length = rest.find(terminator);
+  if (length == rest.npos)
+  {
+    m_pos = m_end;
+    return {TokenType::Invalid, rest};
+  }
+
+  m_pos += length + terminator.size();
+  return {type, rest.substr(0, length)};
+}
+
+ps::Scanner::Token ps::Scanner::ReadBinary()
+{
+  const char *start = m_pos - 1;
+  auto code = static_cast<unsigned char>(*start);
+  auto available = static_cast<size_t>(m_end - start);
+  size_t length = 0;
+  switch (code)
+  {
+  case 128:
+  case 129:
+  case 130:
+  case 131:
+    // The length in the header includes the header
+    if (available >= 4 && start[1] != 0)
+      length = ReadUnsigned(start + 2, 2, code & 1);
+    else if (available >= 8)
+      length = ReadUnsigned(start + 4, 4, code & 1);
+    break;
+  case 132:
+  case 133:
+  case 138:
+  case 139:
+  case 140:
+    length = 5;
+    break;
+  case 134:
+  case 135:
+    length = 3;
+    break;
+  case 136:
+  case 141:
+  case 145:
+  case 146:
+  case 147:
+  case 148:
+    length = 2;
+    break;
+  case 137:
+    if (available >= 2 && GetNumberSize(start[1]))
+      length = 2 + GetNumberSize(start[1]);
+    break;
+  case 142:
+    if (available >= 2)
+      length = 2 + static_cast<unsigned char>(start[1]);
+    break;
+  case 143:
+  case 144:
+    if (available >= 3)
+      length = 3 + ReadUnsigned(start + 1, 2, code == 144);
+    break;
+  case 149:
+    if (available >= 4 && GetNumberSize(start[1]))
+      length = 4 + GetNumberSize(start[1]) * ReadUnsigned(start + 2, 2, start[1] & 128);
+    break;
+  default:
+    // 150 to 159 are unassigned
+    break;
+  }
+
+  if (length == 0 || length > available)
+    return {TokenType::Invalid, std::string_view(start, 1)};
+  m_pos = start + length;
+  return {TokenType::Binary, std::string_view(start, length)};
+}
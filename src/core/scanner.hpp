@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ps
+{
+// Splits program text into tokens. The text is one contiguous span and
+// tokens are views into it, so nothing is copied; the span has to outlive
+// the tokens. Whitespace, delimiters and comments follow the PLRM, runs of
+// them are scanned a vector register at a time where SSE2 or AVX2 is
+// available. Binary tokens are only measured here, ps::Parser decodes them.
+class Scanner
+{
+public:
+  enum class TokenType
+  {
+    // Names and numbers, the parser tells them apart. [, ], << and >> are
+    // regular tokens too, they're names of operators.
+    Regular,
+    // /name, the text is without the slash
+    LiteralName,
+    // //name, the text is without the slashes
+    ImmediateName,
+    ProcBegin,
+    ProcEnd,
+    // The text is what's between the brackets, escapes aren't resolved
+    String,
+    HexString,
+    Ascii85String,
+    // A binary token or binary object sequence (PLRM 3.14), the text
+    // starts with the token byte
+    Binary,
+    // Unterminated strings, unbalanced ) or >, truncated binary tokens
+    Invalid,
+    End
+  };
+
+  struct Token
+  {
+    TokenType type;
+    std::string_view text;
+  };
+
+  explicit Scanner(std::string_view input)
+      : m_begin(input.data()), m_pos(input.data()), m_end(input.data() + input.size())
+  {
+  }
+
+  Token Next();
+
+  // Where the next token starts, as an offset into the input
+  inline size_t GetOffset() const
+  {
+    return static_cast<size_t>(m_pos - m_begin);
+  }
+
+  static bool IsWhitespace(char c);
+  static bool IsDelimiter(char c);
+
+  // Bytes 128 to 159 start binary tokens
+  static inline bool IsBinaryToken(char c)
+  {
+    return static_cast<unsigned char>(c) >= 128 && static_cast<unsigned char>(c) < 160;
+  }
+
+  // Unsigned integers of binary tokens, `size` bytes in either byte order
+  static inline uint32_t ReadUnsigned(const char *p, size_t size, bool lowFirst)
+  {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; ++i)
+      value = value << 8 | static_cast<unsigned char>(p[lowFirst ? size - 1 - i : i]);
+    return value;
+  }
+
+  // Bytes per number of binary number representation `r`, 0 if it's
+  // invalid
+  static inline size_t GetNumberSize(unsigned char r)
+  {
+    r &= 127;
+    return r < 32 ? 4 : r < 48 ? 2 : r < 50 ? 4 : 0;
+  }
+
+private:
+  // The rest of a (string), m_pos is after the opening parenthesis
+  Token ReadString();
+  // The text up to `terminator`, like the body of a <hex string>
+  Token ReadEnclosed(TokenType type, std::string_view terminator);
+  // m_pos is after the token byte
+  Token ReadBinary();
+
+  const char *m_begin;
+  const char *m_pos;
+  const char *m_end;
+};
+} // namespace ps
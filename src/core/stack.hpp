@@ -0,0 +1,133 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace ps
+{
+// Contiguous stack with a fixed capacity. Bounds are not checked by the
+// accessors, callers check Size()/GetFree() once per operation instead.
+template <class T>
+class Stack
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Stack elements are moved with memmove");
+
+public:
+  inline Stack(size_t capacity)
+      : m_data(std::make_unique<T[]>(capacity)), m_top(m_data.get()), m_capacity(capacity)
+  {
+  }
+
+  inline size_t Size() const
+  {
+    return m_top - m_data.get();
+  }
+
+  inline bool Empty() const
+  {
+    return m_top == m_data.get();
+  }
+
+  inline size_t GetCapacity() const
+  {
+    return m_capacity;
+  }
+
+  inline size_t GetFree() const
+  {
+    return m_capacity - Size();
+  }
+
+  // Element `n` counted from the top, 0 being the topmost
+  inline T &Top(size_t n = 0)
+  {
+    return m_top[-1 - static_cast<ptrdiff_t>(n)];
+  }
+
+  inline const T &Top(size_t n = 0) const
+  {
+    return m_top[-1 - static_cast<ptrdiff_t>(n)];
+  }
+
+  // Element `i` counted from the bottom
+  inline T &operator[](size_t i)
+  {
+    return m_data[i];
+  }
+
+  inline const T &operator[](size_t i) const
+  {
+    return m_data[i];
+  }
+
+  inline void Push(const T &value)
+  {
+    *m_top++ = value;
+  }
+
+  inline T Pop()
+  {
+    return *--m_top;
+  }
+
+  inline void Pop(size_t n)
+  {
+    m_top -= n;
+  }
+
+  inline void Clear()
+  {
+    m_top = m_data.get();
+  }
+
+  // Duplicates the top `n` elements
+  inline void Copy(size_t n)
+  {
+    std::memcpy(static_cast<void *>(m_top), m_top - n, n * sizeof(T));
+    m_top += n;
+  }
+
+  // Rolls the top `n` elements up by `j` positions, j has to be in [0, n)
+  inline void Roll(size_t n, size_t j)
+  {
+    if (j == 0)
+      return;
+
+    T *base = m_top - n;
+    if (GetFree() >= j)
+    {
+      // The free space above the top serves as scratch buffer
+      std::memcpy(static_cast<void *>(m_top), m_top - j, j * sizeof(T));
+      std::memmove(static_cast<void *>(base + j), base, (n - j) * sizeof(T));
+      std::memcpy(static_cast<void *>(base), m_top, j * sizeof(T));
+    }
+    else
+    {
+      std::rotate(base, m_top - j, m_top);
+    }
+  }
+
+  inline T *begin()
+  {
+    return m_data.get();
+  }
+
+  inline T *end()
+  {
+    return m_top;
+  }
+
+  // For code that pushes and pops through raw pointers, such as the JIT
+  inline void SetEnd(T *end)
+  {
+    m_top = end;
+  }
+
+private:
+  std::unique_ptr<T[]> m_data;
+  T *m_top;
+  size_t m_capacity;
+};
+} // namespace ps
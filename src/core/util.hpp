@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string_view>
 
 namespace ps
@@ -15,5 +16,41 @@ public:
     else
       return view;
   }
+
+  // Checked int arithmetic, true if the result doesn't fit. The fallback
+  // computes in 64 bits, which can't overflow for 32 bit operands.
+  inline static bool AddOverflow(int a, int b, int &result)
+  {
+#if defined(__GNUC__)
+    return __builtin_add_overflow(a, b, &result);
+#else
+    return Narrow(int64_t(a) + b, result);
+#endif
+  }
+
+  inline static bool SubOverflow(int a, int b, int &result)
+  {
+#if defined(__GNUC__)
+    return __builtin_sub_overflow(a, b, &result);
+#else
+    return Narrow(int64_t(a) - b, result);
+#endif
+  }
+
+  inline static bool MulOverflow(int a, int b, int &result)
+  {
+#if defined(__GNUC__)
+    return __builtin_mul_overflow(a, b, &result);
+#else
+    return Narrow(int64_t(a) * b, result);
+#endif
+  }
+
+private:
+  inline static bool Narrow(int64_t value, int &result)
+  {
+    result = static_cast<int>(value);
+    return value != result;
+  }
 };
 } // namespace ps
\ No newline at end of file
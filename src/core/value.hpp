@@ -0,0 +1,210 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+#include "object.hpp"
+
+namespace ps
+{
+enum class Opcode : uint16_t;
+
+// A PostScript object as it lives on the stacks and inside dictionaries.
+// Simple objects (integers, reals, booleans, names, marks, null) are stored
+// inline, composite objects reference a ps::Object owned by a ps::VM. Values
+// are trivially copyable.
+class Value final
+{
+public:
+  inline Value()
+  {
+    m_bits = 0;
+  }
+
+  inline explicit Value(ObjectType type)
+  {
+    m_type = type;
+    m_bits = 0;
+  }
+
+  inline explicit Value(int value)
+  {
+    m_type = ObjectType::Integer;
+    m_bits = 0;
+    m_integer = value;
+  }
+
+  inline explicit Value(float value)
+  {
+    m_type = ObjectType::Real;
+    m_bits = 0;
+    m_real = value;
+  }
+
+  inline explicit Value(bool value)
+  {
+    m_type = ObjectType::Boolean;
+    m_bits = 0;
+    m_boolean = value;
+  }
+
+  inline explicit Value(Object *object)
+  {
+    m_type = object->GetType();
+    m_flag = object->IsExecutable() ? ObjectFlag::Executable : ObjectFlag::Literal;
+    m_access = object->GetAccess();
+    m_object = object;
+  }
+
+  inline bool IsExecutable() const
+  {
+    return m_flag == ObjectFlag::Executable;
+  }
+
+  inline ObjectAccess GetAccess() const
+  {
+    return m_access;
+  }
+
+  inline ObjectType GetType() const
+  {
+    return m_type;
+  }
+
+  inline bool IsComposite() const
+  {
+    return m_type == ObjectType::String || m_type == ObjectType::Dict || m_type == ObjectType::Array ||
+           m_type == ObjectType::File;
+  }
+
+  inline int GetInteger() const
+  {
+    return m_integer;
+  }
+
+  inline float GetReal() const
+  {
+    return m_real;
+  }
+
+  inline bool GetBoolean() const
+  {
+    return m_boolean;
+  }
+
+  inline uint32_t GetAtom() const
+  {
+    return m_atom;
+  }
+
+  template<class T>
+  inline T *GetObject() const
+  {
+    return static_cast<T *>(m_object);
+  }
+
+  inline void SetExecutable(bool executable)
+  {
+    m_flag = executable ? ObjectFlag::Executable : ObjectFlag::Literal;
+  }
+
+  inline void SetAccess(ObjectAccess access)
+  {
+    m_access = access;
+  }
+
+  // Builtin operators are stored as their opcode
+  static inline Value Operator(Opcode opcode)
+  {
+    Value result(ObjectType::Operand);
+    result.m_flag = ObjectFlag::Executable;
+    result.m_opcode = opcode;
+    return result;
+  }
+
+  inline Opcode GetOpcode() const
+  {
+    return m_opcode;
+  }
+
+  // A name referenced by its atom in the ps::NameTable
+  static inline Value Name(uint32_t atom, bool executable = true)
+  {
+    Value result(ObjectType::Name);
+    result.m_flag = executable ? ObjectFlag::Executable : ObjectFlag::Literal;
+    result.m_atom = atom;
+    return result;
+  }
+
+  // A view of `length` characters at `offset` into a string's storage
+  static inline Value String(Object *str, uint32_t offset, uint32_t length)
+  {
+    Value result(str);
+    result.m_aux = offset | (length << 16);
+    return result;
+  }
+
+  // A view of `length` elements at `offset` into an array's storage
+  static inline Value Array(Object *array, uint32_t offset, uint32_t length)
+  {
+    Value result(array);
+    result.m_aux = offset | (length << 16);
+    return result;
+  }
+
+  // Part of a string or array view, keeping its attributes
+  inline Value GetInterval(uint32_t offset, uint32_t length) const
+  {
+    Value result = *this;
+    result.m_aux = (GetOffset() + offset) | (length << 16);
+    return result;
+  }
+
+  // Position of a string or array view into its storage
+  inline uint32_t GetOffset() const
+  {
+    return m_aux & 0xFFFF;
+  }
+
+  inline uint32_t GetLength() const
+  {
+    return m_aux >> 16;
+  }
+
+  // A save object, only valid while `id` is the id of save level `level`
+  static inline Value Save(uint16_t level, uint32_t id)
+  {
+    Value result(ObjectType::Save);
+    result.m_aux = level;
+    result.m_integer = static_cast<int32_t>(id);
+    return result;
+  }
+
+  inline uint16_t GetSaveLevel() const
+  {
+    return static_cast<uint16_t>(m_aux);
+  }
+
+  inline uint32_t GetSaveId() const
+  {
+    return static_cast<uint32_t>(m_integer);
+  }
+
+private:
+  ObjectType m_type = ObjectType::None;
+  ObjectFlag m_flag = ObjectFlag::Literal;
+  ObjectAccess m_access = ObjectAccess::Unlimited;
+  uint8_t m_reserved = 0;
+  uint32_t m_aux = 0;
+  union {
+    uint64_t m_bits;
+    int32_t m_integer;
+    float m_real;
+    bool m_boolean;
+    uint32_t m_atom;
+    Object *m_object;
+    Opcode m_opcode;
+  };
+};
+
+static_assert(sizeof(Value) == 16, "ps::Value should stay 16 bytes");
+static_assert(std::is_trivially_copyable<Value>::value, "ps::Value should be trivially copyable");
+} // namespace ps
@@ -0,0 +1,98 @@
+#include "vm.hpp"
+#include <cstring>
+#include <utility>
+
+ps::VM::VM(bool journaling) : m_journaling(journaling)
+{
+  m_chunks.push_back({std::unique_ptr<uint8_t[]>(new uint8_t[ChunkSize]), ChunkSize, 0});
+}
+
+ps::VM::~VM() = default;
+
+void *ps::VM::Allocate(size_t size, size_t align)
+{
+  auto *chunk = &m_chunks[m_current];
+  size_t start = (chunk->used + align - 1) & ~(align - 1);
+
+  if (start + size > chunk->size)
+  {
+    NextChunk(size + align);
+    chunk = &m_chunks[m_current];
+    start = (chunk->used + align - 1) & ~(align - 1);
+  }
+
+  m_used += start + size - chunk->used;
+  chunk->used = start + size;
+  return chunk->data.get() + start;
+}
+
+void ps::VM::NextChunk(size_t size)
+{
+  // Chunks left over from a restore are reused before allocating new ones
+  size_t next = m_current + 1;
+  if (next < m_chunks.size() && m_chunks[next].size >= size)
+  {
+    m_chunks[next].used = 0;
+  }
+  else
+  {
+    size_t chunkSize = size > ChunkSize ? size : ChunkSize;
+    m_chunks.insert(m_chunks.begin() + next, {std::unique_ptr<uint8_t[]>(new uint8_t[chunkSize]), chunkSize, 0});
+  }
+
+  m_current = next;
+}
+
+void ps::VM::Record(const void *addr, size_t size)
+{
+  // Restore replays the oldest record of an address last, so a wider write
+  // only needs a new record for the extra bytes' sake
+  auto &recorded = m_saves.back().journaled[addr];
+  if (recorded >= size)
+    return;
+  recorded = size;
+
+  size_t offset = m_journalData.size();
+  m_journalData.resize(offset + size);
+  std::memcpy(m_journalData.data() + offset, addr, size);
+  m_journal.push_back({const_cast<void *>(addr), size, offset});
+}
+
+uint32_t ps::VM::Save()
+{
+  SavePoint save;
+  save.id = m_nextId++;
+  save.chunk = m_current;
+  save.offset = m_chunks[m_current].used;
+  save.used = m_used;
+  save.journalEntries = m_journal.size();
+  save.journalBytes = m_journalData.size();
+  m_saves.push_back(std::move(save));
+
+  return m_saves.back().id;
+}
+
+bool ps::VM::Restore(uint16_t level, uint32_t id)
+{
+  if (!IsValidSave(level, id))
+    return false;
+
+  const auto save = std::move(m_saves[level - 1]);
+  m_saves.resize(level - 1);
+
+  // Undo modifications of older objects, newest first
+  for (size_t i = m_journal.size(); i > save.journalEntries; --i)
+  {
+    const auto &entry = m_journal[i - 1];
+    std::memcpy(entry.addr, m_journalData.data() + entry.offset, entry.size);
+  }
+  m_journal.resize(save.journalEntries);
+  m_journalData.resize(save.journalBytes);
+
+  // Everything allocated after the save is discarded at once
+  m_current = save.chunk;
+  m_chunks[m_current].used = save.offset;
+  m_used = save.used;
+
+  return true;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "object.hpp"
+
+namespace ps
+{
+// Region allocator backing PostScript virtual memory. Composite objects are
+// bump allocated and never freed individually: `save` records the current
+// high-water mark and `restore` rewinds to it, replaying a journal of the
+// modifications made to objects that are older than the save.
+class VM
+{
+public:
+  // Objects of a VM created with journaling disabled are never restored,
+  // which is what global VM needs.
+  VM(bool journaling = true);
+  ~VM();
+
+  VM(const VM &) = delete;
+  VM &operator=(const VM &) = delete;
+
+  void *Allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+  // Allocates an object followed by `extra` bytes of trailing storage
+  template <class T, class... Args>
+  inline T *New(size_t extra, Args &&... args)
+  {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "VM objects are released without running destructors");
+    void *mem = Allocate(sizeof(T) + extra, alignof(T));
+    T *object = new (mem) T(std::forward<Args>(args)...);
+    object->m_saveLevel = m_journaling ? GetLevel() : Object::GlobalLevel;
+    return object;
+  }
+
+  // Must be called before modifying memory owned by `owner`, so the old
+  // contents can be brought back by restore. Each address is recorded once
+  // per save level.
+  inline void Journal(const Object *owner, const void *addr, size_t size)
+  {
+    if (owner->m_saveLevel < GetLevel())
+      Record(addr, size);
+  }
+
+  // Returns the id of the new save level
+  uint32_t Save();
+  // Rewinds to the state before `level` was saved. `id` has to match the
+  // value returned by Save, so a save object can only be restored once.
+  bool Restore(uint16_t level, uint32_t id);
+
+  inline uint16_t GetLevel() const
+  {
+    return static_cast<uint16_t>(m_saves.size());
+  }
+
+  inline bool IsValidSave(uint16_t level, uint32_t id) const
+  {
+    return level > 0 && level <= m_saves.size() && m_saves[level - 1].id == id;
+  }
+
+  // Bytes handed out by the allocator, including alignment padding
+  inline size_t GetUsed() const
+  {
+    return m_used;
+  }
+
+  // Old contents recorded for restore
+  inline size_t GetJournalSize() const
+  {
+    return m_journalData.size();
+  }
+
+private:
+  struct Chunk
+  {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+    size_t used;
+  };
+
+  struct SavePoint
+  {
+    uint32_t id;
+    size_t chunk;
+    size_t offset;
+    size_t used;
+    size_t journalEntries;
+    size_t journalBytes;
+    // Addresses journaled since the save with the bytes recorded, the old
+    // contents only have to be recorded once
+    std::unordered_map<const void *, size_t> journaled;
+  };
+
+  struct JournalEntry
+  {
+    void *addr;
+    size_t size;
+    size_t offset;
+  };
+
+  void Record(const void *addr, size_t size);
+  void NextChunk(size_t size);
+
+  static constexpr size_t ChunkSize = 64 * 1024;
+
+  std::vector<Chunk> m_chunks;
+  size_t m_current = 0;
+  size_t m_used = 0;
+  std::vector<SavePoint> m_saves;
+  std::vector<JournalEntry> m_journal;
+  std::vector<uint8_t> m_journalData;
+  uint32_t m_nextId = 1;
+  bool m_journaling;
+};
+} // namespace ps
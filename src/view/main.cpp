@@ -1,5 +1,6 @@
-#include <fstream>
+#include <iostream>
 #include <cxxopts.hpp>
+#include "inputbuffer.hpp"
 #include "interpreter.hpp"
 
 int main(int argc, char **argv)
@@ -19,18 +20,19 @@ int main(int argc, char **argv)
     return -1;
   }
 
-  std::ifstream fin(fileInput);
+  ps::InputBuffer input;
 
-  if (fin.fail())
+  if (!input.Open(fileInput.c_str()))
   {
     std::cout << "Failed to open the specified file!";
     options.help();
     return -1;
   }
 
+  // PostScript errors are reported by the interpreter
   ps::Interpreter psi;
 
-  psi.Load(fin);
+  psi.Load(input.GetData());
 
   return 0;
 }
\ No newline at end of file
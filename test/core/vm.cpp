@@ -1,5 +1,31 @@
 #include <gtest/gtest.h>
+#include "compiler.hpp"
+#include "inputbuffer.hpp"
 #include "interpreter.hpp"
+#include "nametable.hpp"
+#include "operators.hpp"
+#include "scanner.hpp"
+#include "objects/array.hpp"
+#include "objects/string.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <thread>
+
+// Counts heap allocations, so tests can check that hot paths don't allocate.
+// The default operator delete releases memory with free.
+static std::atomic<size_t> s_allocations{0};
+
+void* operator new(size_t size)
+{
+	++s_allocations;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
 
 TEST(Interpreter, Arithmetic)
 {
@@ -10,20 +36,104 @@ TEST(Interpreter, Arithmetic)
 	EXPECT_TRUE(psi.Load(input));
 
 	const auto& stack = psi.GetOperandStack();
-	ASSERT_EQ(stack.size(), 1) << "Stack size should have been 1!";
+	ASSERT_EQ(stack.Size(), 1) << "Stack size should have been 1!";
+
+	auto& object = stack.Top();
+	ASSERT_NE(object.GetType(), ps::ObjectType::None) << "Object shouldn't be null!";
 
-	auto& object = stack.top();
-	ASSERT_NE(object, nullptr) << "Object shouldn't be null!";
+	EXPECT_EQ(object.GetAccess(), ps::ObjectAccess::Unlimited) << "Expected access flag 'Unlimited'!";
 
-	EXPECT_EQ(object->GetAccess(), ps::ObjectAccess::Unlimited) << "Expected access flag 'Unlimited'!";
+	EXPECT_EQ(object.GetType(), ps::ObjectType::Real) << "div should always return a real!";
+
+	EXPECT_EQ(object.GetReal(), -0.5f) << "Result isn't -0.5!";
+}
+
+TEST(Interpreter, NumberTypes)
+{
+	std::stringstream input(
+		"7 2 sub 1.5 2 mul 2 0.25 add 1.5 0.5 sub 6 3 div "
+		"2147483647 1 add -2147483647 2 sub 65536 65536 mul 7 2 idiv -7 2 mod 3.5 neg -2147483647 1 sub neg");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	std::vector<ps::Value> expected = {
+		ps::Value(5), ps::Value(3.0f), ps::Value(2.25f), ps::Value(1.0f), ps::Value(2.0f),
+		ps::Value(2147483648.0f), ps::Value(-2147483649.0f), ps::Value(4294967296.0f),
+		ps::Value(3), ps::Value(-1), ps::Value(-3.5f), ps::Value(2147483648.0f)};
+	ASSERT_EQ(stack.Size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i)
+	{
+		ASSERT_EQ(stack[i].GetType(), expected[i].GetType()) << "at " << i;
+		if (expected[i].GetType() == ps::ObjectType::Integer)
+			EXPECT_EQ(stack[i].GetInteger(), expected[i].GetInteger()) << "at " << i;
+		else
+			EXPECT_EQ(stack[i].GetReal(), expected[i].GetReal()) << "at " << i;
+	}
+
+	// Operands stay in place on errors
+	for (auto* content : {"1 0 div", "1 0 idiv", "1 0 mod", "1.0e38 1.0e38 mul"})
+	{
+		std::stringstream error(std::string("clear ") + content);
+		EXPECT_FALSE(psi.Load(error)) << content;
+		EXPECT_EQ(stack.Size(), 3) << content;
+	}
+}
+
+TEST(Interpreter, NumberSyntax)
+{
+	std::stringstream input(
+		".25 -.5 +7 1e10 2.5E-1 16#FF 8#777 2#1010 36#Zz 16#FFFFFFFF "
+		"2147483647 -2147483648 2147483648 -2147483649 1. /x {1e} 0 get -1.5e+2");
+
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
 
-	EXPECT_EQ(object->GetType(), ps::ObjectType::Integer) << "Expected integer!";
+	const auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 18);
 
-	auto integer = std::static_pointer_cast<ps::IntegerObject>(object);
+	auto integer = [&](size_t i, int expected) {
+		EXPECT_EQ(stack[i].GetType(), ps::ObjectType::Integer) << i;
+		EXPECT_EQ(stack[i].GetInteger(), expected) << i;
+	};
+	auto real = [&](size_t i, float expected) {
+		EXPECT_EQ(stack[i].GetType(), ps::ObjectType::Real) << i;
+		EXPECT_FLOAT_EQ(stack[i].GetReal(), expected) << i;
+	};
+	real(0, 0.25f);
+	real(1, -0.5f);
+	integer(2, 7);
+	real(3, 1e10f);
+	real(4, 0.25f);
+	integer(5, 255);
+	integer(6, 511);
+	integer(7, 10);
+	integer(8, 35 * 36 + 35);
+	integer(9, -1);
+	integer(10, 2147483647);
+	integer(11, -2147483647 - 1);
+	real(12, 2147483648.0f);
+	real(13, -2147483649.0f);
+	real(14, 1.0f);
+	EXPECT_EQ(stack[15].GetType(), ps::ObjectType::Name);
+	EXPECT_EQ(stack[16].GetType(), ps::ObjectType::Name) << "1e isn't a number!";
+	real(17, -150.0f);
 
-	ASSERT_NE(integer, nullptr) << "Object is not integer!";
+	for (auto* huge : {"1e50", "-1e50", "0.0001e43", "1e100000000"})
+	{
+		std::stringstream range(huge);
+		EXPECT_FALSE(psi.Load(range)) << huge << " is beyond the float range, a limitcheck!";
+	}
 
-	EXPECT_EQ(integer->GetValue(), 2) << "Result isn't 2!";
+	// Underflows are zero or denormal
+	std::stringstream tiny("clear 1e-50 -1e-50 1e-40 10000e-49 1e-100000000");
+	EXPECT_TRUE(psi.Load(tiny));
+	ASSERT_EQ(stack.Size(), 5);
+	real(0, 0.0f);
+	real(1, 0.0f);
+	real(2, 1e-40f);
+	real(3, 1e-45f);
+	real(4, 0.0f);
 }
 
 TEST(Interpreter, Path)
@@ -46,4 +156,1079 @@ TEST(Interpreter, Path)
 	ps::Interpreter psi;
 	// Missing "newpath"
 	EXPECT_FALSE(psi.Load(input));
-}
\ No newline at end of file
+}
+
+TEST(Value, Layout)
+{
+	static_assert(sizeof(ps::Value) == 16, "Value should be 16 bytes");
+
+	ps::Value integer(42);
+	EXPECT_EQ(integer.GetType(), ps::ObjectType::Integer);
+	EXPECT_FALSE(integer.IsComposite());
+	EXPECT_EQ(integer.GetInteger(), 42);
+
+	ps::Value real(0.5f);
+	EXPECT_EQ(real.GetType(), ps::ObjectType::Real);
+	EXPECT_FLOAT_EQ(real.GetReal(), 0.5f);
+
+	ps::Value copy = real;
+	EXPECT_EQ(copy.GetType(), ps::ObjectType::Real);
+	EXPECT_FLOAT_EQ(copy.GetReal(), 0.5f);
+}
+
+TEST(NameTable, Intern)
+{
+	auto atom = ps::NameTable::Intern("moveto");
+	EXPECT_EQ(ps::NameTable::Intern("moveto"), atom) << "Names should only be interned once!";
+	EXPECT_NE(ps::NameTable::Intern("lineto"), atom);
+
+	const auto& name = ps::NameTable::Get(atom);
+	EXPECT_EQ(name.GetName(), "moveto");
+	EXPECT_EQ(name.GetHash(), ps::NameObject::Hash("moveto"));
+
+	auto value = ps::Value::Name(atom, false);
+	EXPECT_EQ(value.GetType(), ps::ObjectType::Name);
+	EXPECT_FALSE(value.IsExecutable());
+	EXPECT_EQ(value.GetAtom(), atom);
+}
+
+TEST(Scanner, TokenViews)
+{
+	std::string content = "/sq{dup mul}def % comment\r\n\t3 sq[1]";
+	ps::Scanner scanner(content);
+
+	using Type = ps::Scanner::TokenType;
+	std::vector<std::pair<Type, std::string_view>> expected = {
+		{Type::LiteralName, "sq"}, {Type::ProcBegin, "{"}, {Type::Regular, "dup"}, {Type::Regular, "mul"},
+		{Type::ProcEnd, "}"}, {Type::Regular, "def"}, {Type::Regular, "3"}, {Type::Regular, "sq"},
+		{Type::Regular, "["}, {Type::Regular, "1"}, {Type::Regular, "]"}};
+	for (const auto& [type, text] : expected)
+	{
+		auto token = scanner.Next();
+		EXPECT_EQ(token.type, type);
+		EXPECT_EQ(token.text, text);
+		// Tokens point into the input
+		EXPECT_GE(token.text.data(), content.data());
+		EXPECT_LE(token.text.data() + token.text.size(), content.data() + content.size());
+	}
+	EXPECT_EQ(scanner.Next().type, Type::End);
+	EXPECT_EQ(scanner.Next().type, Type::End);
+}
+
+TEST(Scanner, Delimiters)
+{
+	// Long runs cross the blocks the scanner classifies at once
+	std::string content = std::string("/q{bind def}bind def\f\0%", 23) + std::string(40, 'c') + "\r(a(b)\\)c)<4142>" +
+		std::string(37, ' ') + "<~9jqo~>[/x//y<</z>>]" + std::string(70, 'n') + "\t";
+	ps::Scanner scanner(content);
+
+	using Type = ps::Scanner::TokenType;
+	std::vector<std::pair<Type, std::string>> expected = {
+		{Type::LiteralName, "q"}, {Type::ProcBegin, "{"}, {Type::Regular, "bind"}, {Type::Regular, "def"},
+		{Type::ProcEnd, "}"}, {Type::Regular, "bind"}, {Type::Regular, "def"}, {Type::String, "a(b)\\)c"},
+		{Type::HexString, "4142"}, {Type::Ascii85String, "9jqo"}, {Type::Regular, "["}, {Type::LiteralName, "x"},
+		{Type::ImmediateName, "y"}, {Type::Regular, "<<"}, {Type::LiteralName, "z"}, {Type::Regular, ">>"},
+		{Type::Regular, "]"}, {Type::Regular, std::string(70, 'n')}};
+	for (const auto& [type, text] : expected)
+	{
+		auto token = scanner.Next();
+		EXPECT_EQ(token.type, type);
+		EXPECT_EQ(token.text, text);
+	}
+	EXPECT_EQ(scanner.Next().type, Type::End);
+
+	for (std::string invalid : {"(a(b)", ")", "<41", "<~9jq", "> "})
+		EXPECT_EQ(ps::Scanner(invalid).Next().type, Type::Invalid) << invalid;
+}
+
+TEST(Interpreter, StringTokens)
+{
+	std::stringstream input("(a\\(\\n\\101\\\n) <48 6 > <~87cURD]j7BEbo7~> (x");
+
+	ps::Interpreter psi;
+	EXPECT_FALSE(psi.Load(input)) << "Unterminated strings are syntax errors!";
+
+	auto text = [](const ps::Value& value) {
+		EXPECT_EQ(value.GetType(), ps::ObjectType::String);
+		return std::string(value.GetObject<ps::StringObject>()->GetData() + value.GetOffset(), value.GetLength());
+	};
+	const auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 4);
+	EXPECT_EQ(text(stack[0]), "a(\nA");
+	EXPECT_EQ(text(stack[1]), "H`");
+	EXPECT_EQ(text(stack[2]), "Hello world");
+}
+
+TEST(Interpreter, ImmediateNames)
+{
+	// //name is replaced by its value when it's read
+	std::stringstream input("/p {1 2 add} def /q {//p} def /p 5 def 3 4 //add //q");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	const auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_EQ(stack[0].GetInteger(), 7);
+	EXPECT_EQ(stack[1].GetType(), ps::ObjectType::Array) << "The procedure should be pushed, not run!";
+
+	std::stringstream undefined("{//nosuchname}");
+	EXPECT_FALSE(psi.Load(undefined));
+}
+
+TEST(Interpreter, BinaryTokens)
+{
+	auto bytes = [](std::initializer_list<int> values) {
+		std::string result;
+		for (int value : values)
+			result += static_cast<char>(value);
+		return result;
+	};
+
+	std::string content =
+		// 5 3 add, with an integer and a system name token
+		bytes({136, 5, 136, 3, 146, 1}) +
+		// 65536, 1.5, (hi)
+		bytes({132, 0, 1, 0, 0, 138, 0x3F, 0xC0, 0, 0, 142, 2}) + "hi" +
+		// [1.0 1.5 -2.0] as 16-bit fixed point with a scale of 1
+		bytes({149, 33, 0, 3, 0, 2, 0, 3, 0xFF, 0xFC}) +
+		// 2 3 mul as a big-endian object sequence
+		bytes({128, 3, 0, 28, 1, 0, 0, 0, 0, 0, 0, 2, 1, 0, 0, 0, 0, 0, 0, 3, 0x83, 0, 0, 0, 0, 0, 0, 108}) +
+		// [(ab) /x] as a little-endian object sequence
+		bytes({129, 1, 31, 0, 9, 0, 2, 0, 8, 0, 0, 0, 5, 0, 2, 0, 24, 0, 0, 0, 3, 0, 1, 0, 26, 0, 0, 0}) + "abx" +
+		// In a procedure the sequence stays an array
+		"{" + bytes({128, 1, 0, 12, 1, 0, 0, 0, 0, 0, 0, 7}) + "}";
+	std::stringstream input(content);
+
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	const auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 8);
+	EXPECT_EQ(stack[0].GetInteger(), 8);
+	EXPECT_EQ(stack[1].GetInteger(), 65536);
+	EXPECT_FLOAT_EQ(stack[2].GetReal(), 1.5f);
+	EXPECT_EQ(std::string(stack[3].GetObject<ps::StringObject>()->GetData(), stack[3].GetLength()), "hi");
+
+	ASSERT_EQ(stack[4].GetType(), ps::ObjectType::Array);
+	ASSERT_EQ(stack[4].GetLength(), 3);
+	const auto* numbers = stack[4].GetObject<ps::ArrayObject>()->GetData();
+	EXPECT_FLOAT_EQ(numbers[0].GetReal(), 1.0f);
+	EXPECT_FLOAT_EQ(numbers[1].GetReal(), 1.5f);
+	EXPECT_FLOAT_EQ(numbers[2].GetReal(), -2.0f);
+
+	EXPECT_EQ(stack[5].GetInteger(), 6);
+
+	ASSERT_EQ(stack[6].GetType(), ps::ObjectType::Array);
+	ASSERT_EQ(stack[6].GetLength(), 2);
+	const auto* elements = stack[6].GetObject<ps::ArrayObject>()->GetData();
+	EXPECT_EQ(std::string(elements[0].GetObject<ps::StringObject>()->GetData(), elements[0].GetLength()), "ab");
+	EXPECT_EQ(elements[1].GetAtom(), ps::NameTable::Intern("x"));
+	EXPECT_FALSE(elements[1].IsExecutable());
+
+	ASSERT_EQ(stack[7].GetLength(), 1);
+	const auto& nested = stack[7].GetObject<ps::ArrayObject>()->GetData()[0];
+	EXPECT_TRUE(nested.IsExecutable());
+	EXPECT_EQ(nested.GetObject<ps::ArrayObject>()->GetData()[0].GetInteger(), 7);
+
+	// Truncated tokens, unassigned codes and cyclic arrays
+	for (auto invalid : {bytes({132, 0}), bytes({150}), bytes({128, 1, 0, 12, 9, 0, 1, 0, 0, 0, 0, 0})})
+	{
+		std::stringstream error(invalid);
+		EXPECT_FALSE(psi.Load(error));
+	}
+}
+
+TEST(Interpreter, MappedInput)
+{
+	auto path = std::filesystem::temp_directory_path() / "psview_loadfile.ps";
+	{
+		std::ofstream file(path, std::ios::binary);
+		file << "/sq{dup mul}def\r\n3 sq 2.5 -4";
+	}
+
+	ps::InputBuffer buffer;
+	ASSERT_TRUE(buffer.Open(path.string().c_str()));
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(buffer.GetData()));
+	std::filesystem::remove(path);
+
+	const auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_EQ(stack.Top(2).GetInteger(), 9);
+	EXPECT_FLOAT_EQ(stack.Top(1).GetReal(), 2.5f);
+	EXPECT_EQ(stack.Top().GetInteger(), -4);
+
+	EXPECT_FALSE(ps::InputBuffer().Open(path.string().c_str())) << "Missing files can't be opened!";
+
+	// Errors in the program aren't open failures
+	std::string_view error("1 undefinedname");
+	EXPECT_FALSE(psi.Load(error));
+}
+
+TEST(VM, SaveRestore)
+{
+	std::string content = "save 100 string pop 5000 string pop 60000 string pop 40000 string pop";
+	std::stringstream input(content);
+
+	ps::Interpreter psi;
+	auto& vm = psi.GetVM();
+	auto used = vm.GetUsed();
+
+	EXPECT_TRUE(psi.Load(input));
+	EXPECT_EQ(vm.GetLevel(), 1);
+	EXPECT_GT(vm.GetUsed(), used + 105000);
+
+	std::stringstream restore("restore");
+	EXPECT_TRUE(psi.Load(restore));
+	EXPECT_EQ(vm.GetLevel(), 0);
+	EXPECT_EQ(vm.GetUsed(), used) << "Restore should release everything allocated after save!";
+	EXPECT_EQ(psi.GetOperandStack().Size(), 0);
+}
+
+TEST(VM, Journal)
+{
+	ps::VM vm;
+	auto* str = ps::StringObject::Create(vm, 4);
+	std::memcpy(str->GetData(), "abcd", 4);
+
+	auto level = vm.GetLevel() + 1;
+	auto id = vm.Save();
+	vm.Journal(str, str->GetData(), 2);
+	std::memcpy(str->GetData(), "xy", 2);
+	EXPECT_EQ(std::string_view(str->GetData(), 4), "xycd");
+
+	EXPECT_TRUE(vm.Restore(level, id));
+	EXPECT_EQ(std::string_view(str->GetData(), 4), "abcd") << "Restore should undo changes to older objects!";
+	EXPECT_FALSE(vm.Restore(level, id)) << "A save can only be restored once!";
+
+	// Repeated writes are recorded once per save level
+	auto outer = vm.Save();
+	for (int i = 0; i < 100; ++i)
+	{
+		vm.Journal(str, str->GetData(), 2);
+		auto inner = vm.Save();
+		vm.Journal(str, str->GetData(), 2);
+		vm.Restore(level + 1, inner);
+	}
+	EXPECT_EQ(vm.GetJournalSize(), 2);
+	vm.Journal(str, str->GetData(), 4);
+	std::memcpy(str->GetData(), "wxyz", 4);
+	EXPECT_TRUE(vm.Restore(level, outer));
+	EXPECT_EQ(std::string_view(str->GetData(), 4), "abcd");
+}
+
+TEST(Interpreter, Dictionaries)
+{
+	std::string content = R"(
+	/x 10 def
+	/d 3 dict def
+	d begin /x 20 def /y 30 def end
+	x
+	d /x known
+	d /z known
+	/y where
+	d begin x end
+	)";
+	std::stringstream input(content);
+
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 5);
+	EXPECT_EQ(stack.Top().GetInteger(), 20);
+	stack.Pop();
+	EXPECT_FALSE(stack.Top().GetBoolean()) << "y is only defined in d!";
+	stack.Pop();
+	EXPECT_FALSE(stack.Top().GetBoolean());
+	stack.Pop();
+	EXPECT_TRUE(stack.Top().GetBoolean());
+	stack.Pop();
+	EXPECT_EQ(stack.Top().GetInteger(), 10);
+
+	for (auto* size : {"65536", "2147483647"})
+	{
+		std::stringstream huge(std::string("clear ") + size + " dict");
+		EXPECT_FALSE(psi.Load(huge)) << size;
+		EXPECT_EQ(stack[0].GetInteger(), std::atoi(size)) << "The operand should stay in place!";
+	}
+
+	// Integral reals are integer keys, the others stay reals
+	std::stringstream reals("clear /r 4 dict def r 3 1 put r 3.0 known r 1e20 2 put r 1e20 get r 3.5 known");
+	EXPECT_TRUE(psi.Load(reals));
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_TRUE(stack[0].GetBoolean());
+	EXPECT_EQ(stack[1].GetInteger(), 2);
+	EXPECT_FALSE(stack[2].GetBoolean());
+
+	// Intervals of one array are different keys, equal intervals the same
+	std::stringstream intervals("clear /d 4 dict def /a [1 2] def d a 0 1 getinterval 1 put "
+								"d a 1 1 getinterval known d a 0 1 getinterval known");
+	EXPECT_TRUE(psi.Load(intervals));
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_FALSE(stack[0].GetBoolean());
+	EXPECT_TRUE(stack[1].GetBoolean());
+}
+
+TEST(Dict, OpenAddressing)
+{
+	ps::VM vm;
+	auto* dict = ps::DictObject::Create(vm, 4);
+	EXPECT_EQ(dict->GetMaxLength(), 4);
+
+	for (int i = 0; i < 100; ++i)
+		dict->Put(vm, ps::Value(i), ps::Value(i * 2));
+
+	EXPECT_EQ(dict->GetLength(), 100);
+	EXPECT_GE(dict->GetMaxLength(), 100) << "Dictionary should grow when full!";
+
+	for (int i = 0; i < 100; i += 2)
+		EXPECT_TRUE(dict->Remove(vm, ps::Value(i)));
+
+	EXPECT_EQ(dict->GetLength(), 50);
+	for (int i = 0; i < 100; ++i)
+	{
+		auto* value = dict->Find(ps::Value(i));
+		if (i % 2 == 0)
+			EXPECT_EQ(value, nullptr);
+		else
+		{
+			ASSERT_NE(value, nullptr);
+			EXPECT_EQ(value->GetInteger(), i * 2);
+		}
+	}
+}
+
+TEST(Dict, Restore)
+{
+	ps::VM vm;
+	auto* dict = ps::DictObject::Create(vm, 2);
+	auto key = ps::Value::Name(ps::NameTable::Intern("key"), false);
+	dict->Put(vm, key, ps::Value(1));
+
+	auto id = vm.Save();
+	dict->Put(vm, key, ps::Value(2));
+	for (int i = 0; i < 20; ++i)
+		dict->Put(vm, ps::Value(i), ps::Value(i));
+	EXPECT_EQ(dict->GetLength(), 21);
+
+	EXPECT_TRUE(vm.Restore(1, id));
+	EXPECT_EQ(dict->GetLength(), 1);
+	EXPECT_EQ(dict->GetMaxLength(), 2);
+	ASSERT_NE(dict->Find(key), nullptr);
+	EXPECT_EQ(dict->Find(key)->GetInteger(), 1);
+}
+
+TEST(Interpreter, BindingCache)
+{
+	std::string content = R"(
+	/x 1 def x
+	/d 1 dict def d begin x /x 2 def x /y 0 def /z 0 def x end
+	x /x 3 def x
+	d /x undef d begin x end
+	)";
+	std::stringstream input(content);
+
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	std::vector<int> expected = {1, 1, 2, 2, 1, 3, 3};
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), expected.size());
+	for (auto it = expected.rbegin(); it != expected.rend(); ++it)
+	{
+		EXPECT_EQ(stack.Top().GetInteger(), *it);
+		stack.Pop();
+	}
+}
+
+TEST(Interpreter, StackOperators)
+{
+	std::string content = "1 2 3 4 5 3 1 roll 2 index 2 copy mark 7 8 counttomark";
+	std::stringstream input(content);
+
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	std::vector<int> expected = {1, 2, 5, 3, 4, 5, 4, 5, 0, 7, 8, 2};
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i)
+	{
+		if (stack[i].GetType() == ps::ObjectType::Mark)
+			EXPECT_EQ(i, 8);
+		else
+			EXPECT_EQ(stack[i].GetInteger(), expected[i]);
+	}
+
+	// Counts near the integer limit are underflows, not overflows
+	std::pair<std::string, size_t> huge[] = {
+		{"1 2 2147483647 copy", 4}, {"1 2 2147483647 index", 4}, {"1 2 2147483647 0 roll", 5}};
+	for (auto& [content, size] : huge)
+	{
+		std::stringstream program(content);
+		ps::Interpreter large;
+		EXPECT_FALSE(large.Load(program)) << content;
+		EXPECT_EQ(large.GetOperandStack().Size(), size) << "The operands should stay in place for " << content;
+	}
+}
+
+TEST(Interpreter, StackErrors)
+{
+	std::stringstream underflow("1 exch");
+	ps::Interpreter psi;
+	EXPECT_FALSE(psi.Load(underflow));
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 2) << "Operands should be left untouched on error!";
+	EXPECT_EQ(stack[0].GetInteger(), 1);
+	EXPECT_EQ(stack[1].GetOpcode(), ps::Opcode::Exch) << "The offending command should be pushed!";
+
+	ps::StackLimits limits;
+	limits.operandStack = 4;
+	ps::Interpreter small(ps::ScriptMode::Standalone, limits);
+	std::stringstream overflow("1 2 3 4 dup");
+	EXPECT_FALSE(small.Load(overflow));
+	EXPECT_EQ(small.GetOperandStack().Size(), 1) << "A full stack should be dropped for the offending command!";
+
+	std::stringstream restore("save 1 string restore");
+	EXPECT_FALSE(psi.Load(restore)) << "Restore should fail with a newer string on the stack!";
+}
+
+TEST(Interpreter, SharedSystemDict)
+{
+	ps::Interpreter a;
+	ps::Interpreter b;
+	EXPECT_EQ(a.GetSystemDict(), b.GetSystemDict()) << "systemdict should be shared!";
+	EXPECT_NE(a.GetUserDict(), b.GetUserDict());
+
+	std::stringstream input("systemdict begin /add 1 def");
+	EXPECT_FALSE(a.Load(input)) << "systemdict should be read-only!";
+	EXPECT_EQ(a.GetOperandStack().Size(), 3) << "The operands should stay in place!";
+
+	std::stringstream stopped("clear systemdict begin /x 2 {def} stopped systemdict /add {undef} stopped");
+	EXPECT_TRUE(a.Load(stopped));
+	const auto& stack = a.GetOperandStack();
+	// The operands, the offending operator and true from stopped
+	ASSERT_EQ(stack.Size(), 8);
+	EXPECT_EQ(stack[1].GetInteger(), 2);
+	EXPECT_TRUE(stack[3].GetBoolean());
+	EXPECT_EQ(stack[4].GetType(), ps::ObjectType::Dict);
+	EXPECT_TRUE(stack[7].GetBoolean());
+
+	std::vector<std::thread> threads;
+	std::vector<int> results(4);
+	for (int i = 0; i < 4; ++i)
+	{
+		threads.emplace_back([i, &results]() {
+			for (int j = 0; j < 100; ++j)
+			{
+				ps::Interpreter psi;
+				std::stringstream job("/x " + std::to_string(i) + " def x 10 mul x add");
+				psi.Load(job);
+				results[i] = psi.GetOperandStack().Top().GetInteger();
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	for (int i = 0; i < 4; ++i)
+		EXPECT_EQ(results[i], i * 11);
+}
+
+TEST(Operators, PerfectHash)
+{
+	auto* table = ps::Operators::GetTable();
+	for (size_t i = 0; i < ps::Operators::GetCount(); ++i)
+		EXPECT_EQ(ps::Operators::Find(table[i].name), &table[i]) << table[i].name;
+
+	EXPECT_EQ(ps::Operators::Find("nosuchoperator"), nullptr);
+	EXPECT_EQ(ps::Operators::Find(""), nullptr);
+
+	auto* roll = ps::Operators::Find("roll");
+	ASSERT_NE(roll, nullptr);
+	EXPECT_EQ(roll->operandCount, 2);
+	EXPECT_EQ(roll->GetType(0), ps::operand::Integer);
+}
+
+TEST(Operators, SignatureCheck)
+{
+	std::stringstream input("/a 1 add");
+	ps::Interpreter psi;
+	EXPECT_FALSE(psi.Load(input));
+	EXPECT_EQ(psi.GetOperandStack().Size(), 3) << "Operands should be left untouched on typecheck!";
+}
+
+TEST(Operators, OpcodeDispatch)
+{
+	std::stringstream input("/add load 7 3 exch dup pop add 4 5 mul");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_EQ(stack[0].GetType(), ps::ObjectType::Operand);
+	EXPECT_EQ(stack[0].GetOpcode(), ps::Opcode::Add);
+	EXPECT_EQ(ps::Operators::Get(stack[0].GetOpcode()).name, "add");
+	EXPECT_EQ(stack[1].GetInteger(), 10);
+	EXPECT_EQ(stack[2].GetInteger(), 20);
+}
+
+TEST(String, SharedIntervals)
+{
+	std::string content = R"(
+	/s 5 string def
+	s 0 104 put s 1 101 put s 2 108 put s 3 108 put s 4 111 put
+	/sub s 1 3 getinterval def
+	sub 0 69 put
+	s 1 get
+	sub length
+	s 2 sub putinterval
+	s 4 get
+	)";
+	std::stringstream input(content);
+
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_EQ(stack[0].GetInteger(), 'E') << "getinterval should share storage!";
+	EXPECT_EQ(stack[1].GetInteger(), 3);
+	EXPECT_EQ(stack[2].GetInteger(), 'l') << "putinterval should write through!";
+}
+
+TEST(String, Search)
+{
+	std::string content = R"(
+	/s 5 string def
+	s 0 97 put s 1 98 put s 2 99 put s 3 100 put s 4 101 put
+	/seek 2 string def seek 0 99 put seek 1 100 put
+	s seek search
+	)";
+	std::stringstream input(content);
+
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 4);
+	EXPECT_TRUE(stack[3].GetBoolean());
+	EXPECT_EQ(stack[2].GetOffset(), 0);
+	EXPECT_EQ(stack[2].GetLength(), 2);
+	EXPECT_EQ(stack[1].GetOffset(), 2);
+	EXPECT_EQ(stack[1].GetLength(), 2);
+	EXPECT_EQ(stack[0].GetOffset(), 4);
+	EXPECT_EQ(stack[0].GetLength(), 1);
+	EXPECT_EQ(stack[0].GetObject<ps::Object>(), stack[1].GetObject<ps::Object>()) << "Results should share storage!";
+
+	ps::StackLimits limits;
+	limits.operandStack = 4;
+	ps::Interpreter small(ps::ScriptMode::Standalone, limits);
+	std::stringstream full("1 2 1 string 1 string anchorsearch");
+	EXPECT_FALSE(small.Load(full)) << "A match on a full stack should overflow!";
+	EXPECT_EQ(small.GetOperandStack().Size(), 1);
+}
+
+TEST(Interpreter, Procedures)
+{
+	std::stringstream input("/sq {dup mul} def /f {sq 1 add} def 3 f {2 3 add} dup exec 4 {sq} exec");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 4);
+	EXPECT_EQ(stack[0].GetInteger(), 10);
+	EXPECT_EQ(stack[1].GetType(), ps::ObjectType::Array) << "Procedures encountered directly are data!";
+	EXPECT_TRUE(stack[1].IsExecutable());
+	EXPECT_EQ(stack[1].GetLength(), 3);
+	EXPECT_EQ(stack[2].GetInteger(), 5);
+	EXPECT_EQ(stack[3].GetInteger(), 16);
+	EXPECT_EQ(psi.GetExecutionStack().Size(), 0);
+
+	std::stringstream unmatched("{1 2");
+	EXPECT_FALSE(psi.Load(unmatched));
+	std::stringstream extra("1 }");
+	EXPECT_FALSE(psi.Load(extra));
+}
+
+TEST(Interpreter, ExecutableStrings)
+{
+	// Read a token at a time like files, whether run by exec, a name or a
+	// procedure. The hex string holds 2 3 mul as a binary object sequence.
+	std::stringstream input("(1 2 add 10 mul) cvx exec /s (3 4 mul) cvx def s /p {(5 6) cvx exec add} def p "
+							"<80 03 00 1C 01 00 00 00 00 00 00 02 01 00 00 00 00 00 00 03 83 00 00 00 00 00 00 6C> "
+							"cvx exec () cvx exec");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	const auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 4);
+	EXPECT_EQ(stack[0].GetInteger(), 30);
+	EXPECT_EQ(stack[1].GetInteger(), 12);
+	EXPECT_EQ(stack[2].GetInteger(), 11);
+	EXPECT_EQ(stack[3].GetInteger(), 6);
+	EXPECT_EQ(psi.GetExecutionStack().Size(), 0);
+
+	std::stringstream unbalanced("(1 }) cvx exec");
+	EXPECT_FALSE(psi.Load(unbalanced));
+}
+
+TEST(Interpreter, ExecutionStack)
+{
+	// Each level keeps its caller on the execution stack, none of them uses
+	// the native stack
+	std::string chain = "/p0 {countexecstack} def\n";
+	for (int i = 1; i < 200; ++i)
+		chain += "/p" + std::to_string(i) + " {p" + std::to_string(i - 1) + " 0 pop} def\n";
+	std::stringstream nested(chain + "p199");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(nested));
+	ASSERT_EQ(psi.GetOperandStack().Size(), 1);
+	EXPECT_EQ(psi.GetOperandStack().Top().GetInteger(), 200) << "The file and p1 to p199 should be on the execution stack!";
+
+	ps::StackLimits limits;
+	limits.execStack = 100;
+	ps::Interpreter small(ps::ScriptMode::Standalone, limits);
+	std::stringstream overflow(chain + "p199");
+	EXPECT_FALSE(small.Load(overflow));
+	EXPECT_EQ(small.GetExecutionStack().Size(), 0);
+
+	// Tail calls don't grow the execution stack
+	std::string tail = "/t0 {countexecstack} def\n";
+	for (int i = 1; i < 200; ++i)
+		tail += "/t" + std::to_string(i) + " {0 pop t" + std::to_string(i - 1) + "} def\n";
+	std::stringstream tailcalls(tail + "t199");
+	ps::Interpreter psi2(ps::ScriptMode::Standalone, limits);
+	EXPECT_TRUE(psi2.Load(tailcalls));
+	EXPECT_EQ(psi2.GetOperandStack().Top().GetInteger(), 1) << "Only the file should be on the execution stack!";
+
+	std::stringstream execstack("/q {5 array execstack 0 pop} def q");
+	ps::Interpreter psi3;
+	EXPECT_TRUE(psi3.Load(execstack));
+	auto& exec = psi3.GetOperandStack().Top();
+	EXPECT_EQ(exec.GetType(), ps::ObjectType::Array);
+	EXPECT_EQ(exec.GetLength(), 2);
+	EXPECT_EQ(exec.GetObject<ps::ArrayObject>()->GetData()[0].GetType(), ps::ObjectType::Null)
+		<< "Files must not outlive their Load!";
+
+	// Loop continuations handed out by execstack check for their frame
+	std::stringstream loops("/a 1 1 1 {pop 1 {[0] {pop {100 array execstack exit} loop} forall} repeat} for def\n"
+							"a {{exec} stopped clear} forall a");
+	ps::Interpreter psi4;
+	EXPECT_TRUE(psi4.Load(loops));
+	ASSERT_EQ(psi4.GetOperandStack().Size(), 1);
+	auto& entries = psi4.GetOperandStack().Top();
+	std::vector<ps::Opcode> continuations;
+	for (uint32_t i = 0; i < entries.GetLength(); ++i)
+	{
+		auto& entry = entries.GetObject<ps::ArrayObject>()->GetData()[entries.GetOffset() + i];
+		if (entry.GetType() == ps::ObjectType::Operand)
+			continuations.push_back(entry.GetOpcode());
+	}
+	EXPECT_EQ(continuations, std::vector<ps::Opcode>({ps::Opcode::ForContinue, ps::Opcode::RepeatContinue,
+													  ps::Opcode::ForAllContinue, ps::Opcode::LoopContinue}));
+}
+
+TEST(Array, Operators)
+{
+	std::stringstream input("[1 2 3] dup 1 get exch dup 0 9 put aload pop add add 4 array dup 1 [7 8] putinterval 1 2 getinterval length");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_EQ(stack[0].GetInteger(), 2);
+	EXPECT_EQ(stack[1].GetInteger(), 14);
+	EXPECT_EQ(stack[2].GetInteger(), 2);
+
+	std::stringstream unmatched("1 2 ]");
+	EXPECT_FALSE(psi.Load(unmatched));
+}
+
+TEST(Interpreter, ControlOperators)
+{
+	std::stringstream input(
+		"0 1 1 10 {add} for "
+		"1 0.5 2 {} for "
+		"0 5 {1 add} repeat "
+		"0 {1 add exit} loop "
+		"0 [1 2 3] {add} forall "
+		"0 2 string dup 0 97 put dup 1 98 put {add} forall "
+		"0 2 dict dup /a 2 put dup /b 4 put {exch pop add} forall "
+		"true {1} {2} ifelse false {3} if "
+		"0 {3 {1 add exit} repeat 10 add exit} loop");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	std::vector<float> expected = {55, 1, 1.5, 2, 5, 1, 6, 195, 6, 1, 11};
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i)
+	{
+		auto& value = stack[i];
+		float actual = value.GetType() == ps::ObjectType::Real ? value.GetReal() : value.GetInteger();
+		EXPECT_EQ(actual, expected[i]) << "at " << i;
+	}
+	EXPECT_EQ(psi.GetExecutionStack().Size(), 0);
+
+	std::stringstream exit("exit");
+	EXPECT_FALSE(psi.Load(exit)) << "exit outside of a loop should be invalidexit!";
+}
+
+TEST(Interpreter, LoopsDontAllocate)
+{
+	auto run = [](int iterations) {
+		std::stringstream input("/inc {1 add} def 0 " + std::to_string(iterations) + " {inc dup pop} repeat");
+		ps::Interpreter psi;
+		size_t before = s_allocations;
+		EXPECT_TRUE(psi.Load(input));
+		EXPECT_EQ(psi.GetOperandStack().Top().GetInteger(), iterations);
+		return s_allocations - before;
+	};
+
+	run(10);
+	size_t few = run(10);
+	size_t many = run(1000000);
+	EXPECT_EQ(many, few) << "Iterations shouldn't allocate!";
+}
+
+TEST(Interpreter, Bind)
+{
+	std::stringstream input(
+		"/inc {1 add} bind def /f {x {mul} exec} bind def "
+		"/add {mul} def 5 inc /f load");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_EQ(stack[0].GetInteger(), 6) << "Bound procedures should call the operator, not the new definition!";
+
+	auto f = stack[1];
+	ASSERT_EQ(f.GetType(), ps::ObjectType::Array);
+	auto* elements = f.GetObject<ps::ArrayObject>()->GetData() + f.GetOffset();
+	EXPECT_EQ(elements[0].GetType(), ps::ObjectType::Name) << "Undefined names should stay names!";
+	EXPECT_EQ(elements[1].GetAccess(), ps::ObjectAccess::ReadOnly) << "Nested procedures should become read-only!";
+	auto* nested = elements[1].GetObject<ps::ArrayObject>()->GetData() + elements[1].GetOffset();
+	EXPECT_EQ(nested[0].GetType(), ps::ObjectType::Operand);
+	EXPECT_EQ(nested[0].GetOpcode(), ps::Opcode::Mul);
+	EXPECT_EQ(elements[2].GetOpcode(), ps::Opcode::Exec);
+
+	std::stringstream readonly("/f load 1 get 0 1 put");
+	EXPECT_FALSE(psi.Load(readonly));
+}
+
+TEST(Interpreter, Bytecode)
+{
+	std::stringstream input("/p {1 2 add exch {3} if x {4} {5} ifelse 2 {6} repeat} bind def");
+	ps::Interpreter psi;
+	psi.SetConstantFolding(false);
+	EXPECT_TRUE(psi.Load(input));
+
+	auto p = *psi.DictLookup(ps::Value::Name(ps::NameTable::Intern("p")));
+	auto* array = p.GetObject<ps::ArrayObject>();
+	EXPECT_EQ(array->GetCode(), nullptr) << "Procedures should be compiled on first execution!";
+
+	std::stringstream run("/x false def true p");
+	EXPECT_TRUE(psi.Load(run));
+	auto* code = array->GetCode();
+	ASSERT_NE(code, nullptr);
+	EXPECT_EQ(code[0].op, ps::Bytecode::Region);
+	EXPECT_EQ(code[0].span, 5) << "The region should end at if!";
+	EXPECT_EQ(code[1].op, ps::Bytecode::PushCall);
+	EXPECT_EQ(code[2].op, ps::Bytecode::Operator);
+	EXPECT_EQ(code[4].op, ps::Bytecode::If);
+	EXPECT_EQ(code[4].span, 2);
+	EXPECT_EQ(code[6].op, ps::Bytecode::Generic);
+	EXPECT_EQ(code[7].op, ps::Bytecode::IfElse);
+	EXPECT_EQ(code[11].op, ps::Bytecode::PushCall);
+	EXPECT_EQ(code[11].opcode, ps::Opcode::Repeat);
+
+	auto& stack = psi.GetOperandStack();
+	std::vector<int> expected = {3, 3, 5, 6, 6};
+	ASSERT_EQ(stack.Size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i)
+		EXPECT_EQ(stack[i].GetInteger(), expected[i]) << "at " << i;
+
+	// Changing an element drops the code, intervals start in the middle
+	std::stringstream put("clear /p load 0 5 put false p /p load 7 2 getinterval exec");
+	EXPECT_TRUE(psi.Load(put));
+	ASSERT_EQ(stack.Size(), 6);
+	EXPECT_EQ(stack[0].GetInteger(), 7);
+	EXPECT_EQ(stack[3].GetInteger(), 6);
+	EXPECT_EQ(stack[4].GetType(), ps::ObjectType::Array) << "ifelse was cut off, its procedures are data!";
+
+	// Code compiled after a save is dropped by restore
+	std::stringstream restore("clear /p load 0 1 put save /s exch def true p clear s restore");
+	EXPECT_TRUE(psi.Load(restore));
+	EXPECT_EQ(array->GetCode(), nullptr);
+}
+
+TEST(Interpreter, Jit)
+{
+	std::stringstream input(
+		"/f {1 add dup 1 mul exch 1 index exch pop pop 2 string length add} bind def "
+		"/g {add} bind def "
+		"0 100 {f} repeat 0 100 {f} repeat add "
+		"100 {1 2 g pop} repeat 5 100 {2 g} repeat");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_EQ(stack[0].GetInteger(), 600);
+	EXPECT_EQ(stack[1].GetInteger(), 205);
+
+	auto f = *psi.DictLookup(ps::Value::Name(ps::NameTable::Intern("f")));
+#ifdef PS_JIT
+	EXPECT_NE(f.GetObject<ps::ArrayObject>()->GetNative(), nullptr) << "Hot procedures should be compiled!";
+#endif
+
+	// Failed guards fall back to the interpreter, errors leave the operands
+	std::stringstream fallback("clear 1 /x g");
+	EXPECT_FALSE(psi.Load(fallback));
+	EXPECT_EQ(stack.Size(), 3);
+
+	std::stringstream redefine("clear /f load 0 2 put 0 f");
+	EXPECT_TRUE(psi.Load(redefine));
+	EXPECT_EQ(f.GetObject<ps::ArrayObject>()->GetNative(), nullptr) << "put should drop the native code!";
+	EXPECT_EQ(stack.Top().GetInteger(), 4);
+
+	// Handlers that return continue after the failed element
+	std::stringstream resume(
+		"clear errordict /typecheck {pop} put /p {1 add 5} bind def 40 {2 /p load exec clear} repeat (a) /p load exec");
+	EXPECT_TRUE(psi.Load(resume));
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_EQ(stack[0].GetType(), ps::ObjectType::String);
+	EXPECT_EQ(stack[1].GetInteger(), 1);
+	EXPECT_EQ(stack[2].GetInteger(), 5);
+}
+
+TEST(Interpreter, Superinstructions)
+{
+	std::stringstream input("/p {/a exch def 1 2 3 3 -1 roll 1 index exch pop a 2 add} def 7 p");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	std::vector<int> expected = {2, 3, 3, 9};
+	ASSERT_EQ(stack.Size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i)
+		EXPECT_EQ(stack[i].GetInteger(), expected[i]) << "at " << i;
+
+	// Only bound operators are fused
+	auto p = *psi.DictLookup(ps::Value::Name(ps::NameTable::Intern("p")));
+	EXPECT_EQ(p.GetObject<ps::ArrayObject>()->GetCode()[1].op, ps::Bytecode::Generic);
+
+	std::stringstream bound("/p load bind pop");
+	EXPECT_TRUE(psi.Load(bound));
+	auto* code = p.GetObject<ps::ArrayObject>()->GetCode();
+	EXPECT_EQ(code, nullptr) << "bind should drop the code!";
+	std::stringstream run("clear 7 p");
+	EXPECT_TRUE(psi.Load(run));
+	code = p.GetObject<ps::ArrayObject>()->GetCode();
+	ASSERT_NE(code, nullptr);
+	EXPECT_EQ(code[1].op, ps::Bytecode::ExchDef);
+	EXPECT_EQ(code[6].op, ps::Bytecode::Roll);
+	EXPECT_EQ(code[9].op, ps::Bytecode::Index);
+	EXPECT_EQ(code[11].op, ps::Bytecode::ExchPop);
+	EXPECT_EQ(code[14].op, ps::Bytecode::PushCall);
+	ASSERT_EQ(stack.Size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i)
+		EXPECT_EQ(stack[i].GetInteger(), expected[i]) << "at " << i;
+
+	// Without their fast path the elements run one by one
+	std::stringstream unfused("clear /q {1 index} bind def q");
+	EXPECT_FALSE(psi.Load(unfused));
+	EXPECT_EQ(stack.Size(), 2) << "index should fail with its operand in place!";
+}
+
+TEST(Interpreter, Inlining)
+{
+	std::stringstream input(
+		"/_c {2 add} bind def /l {_c 3 mul} bind def /n {l} def "
+		"/p {1 l 1 n} def p");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_EQ(stack[0].GetInteger(), 9);
+	EXPECT_EQ(stack[1].GetInteger(), 9);
+
+	auto p = *psi.DictLookup(ps::Value::Name(ps::NameTable::Intern("p")));
+	auto* code = p.GetObject<ps::ArrayObject>()->GetCode();
+	ASSERT_NE(code, nullptr);
+	ASSERT_EQ(code[1].op, ps::Bytecode::Inline) << "Thin wrappers should be inlined!";
+	EXPECT_EQ(code[1].body->length, 4);
+	EXPECT_EQ(code[1].body->guardCount, 2);
+	EXPECT_EQ(code[3].op, ps::Bytecode::Inline) << "Nested wrappers should be inlined!";
+
+	// Redefining a callee, even a nested one, invalidates the inlined copy
+	std::stringstream redefine("clear /_c {5 add} def p");
+	EXPECT_TRUE(psi.Load(redefine));
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_EQ(stack[0].GetInteger(), 18);
+	EXPECT_EQ(stack[1].GetInteger(), 18);
+
+	std::stringstream put("clear /_c load 0 1 put p");
+	EXPECT_TRUE(psi.Load(put));
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_EQ(stack[0].GetInteger(), 6);
+
+	// Shadowing a callee too
+	std::stringstream shadow("clear 1 dict begin /l {pop 0} def p end");
+	EXPECT_TRUE(psi.Load(shadow));
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_EQ(stack[0].GetInteger(), 0);
+	EXPECT_EQ(stack[1].GetInteger(), 0);
+
+	// Errors inside inlined elements leave the operands in place
+	std::stringstream error("clear /q {/x l} def q");
+	EXPECT_FALSE(psi.Load(error));
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_EQ(stack.Top().GetOpcode(), ps::Opcode::Add);
+
+	// Handlers that return continue after the failed element, like in a call
+	std::stringstream resume(
+		"clear /w {add 7} bind def /r {w 8} def errordict /stackunderflow {pop} put 1 r");
+	EXPECT_TRUE(psi.Load(resume));
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_EQ(stack[0].GetInteger(), 1);
+	EXPECT_EQ(stack[1].GetInteger(), 7);
+	EXPECT_EQ(stack[2].GetInteger(), 8);
+}
+
+TEST(Interpreter, StopAndStopped)
+{
+	std::stringstream input(
+		"{1 2 stop 3} stopped {4} stopped {5 /x add} stopped $error /errorname get "
+		"{exit} stopped 3 {10 {11 stop} repeat} stopped "
+		"errordict /undefined {pop 42} put nosuchname");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+	EXPECT_EQ(psi.GetExecutionStack().Size(), 0);
+
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 16);
+	std::vector<std::pair<size_t, bool>> stopped = {{2, true}, {4, false}, {8, true}, {11, true}, {14, true}};
+	for (auto [i, value] : stopped)
+	{
+		ASSERT_EQ(stack[i].GetType(), ps::ObjectType::Boolean) << "at " << i;
+		EXPECT_EQ(stack[i].GetBoolean(), value) << "at " << i;
+	}
+	EXPECT_EQ(stack[1].GetInteger(), 2);
+	EXPECT_EQ(stack[7].GetOpcode(), ps::Opcode::Add) << "Errors should push the offending command!";
+	EXPECT_EQ(stack[9].GetAtom(), ps::NameTable::Intern("typecheck"));
+	EXPECT_EQ(stack[10].GetOpcode(), ps::Opcode::Exit) << "exit shouldn't leave a stopped context!";
+	EXPECT_EQ(stack[13].GetInteger(), 11);
+	EXPECT_EQ(stack[15].GetInteger(), 42) << "errordict handlers should run instead of stop!";
+
+	// Outside of stopped the job ends
+	std::stringstream stop("clear 8 stop 9");
+	EXPECT_FALSE(psi.Load(stop));
+	ASSERT_EQ(stack.Size(), 1);
+	EXPECT_EQ(stack[0].GetInteger(), 8);
+	EXPECT_EQ(psi.GetExecutionStack().Size(), 0);
+
+	std::stringstream next("clear 1 2 add");
+	EXPECT_TRUE(psi.Load(next));
+	EXPECT_EQ(stack.Top().GetInteger(), 3);
+}
+
+TEST(Interpreter, ConstantFolding)
+{
+	const char* content =
+		"/p {72 300 div 2 mul 1 0 idiv pop true {1} {2} ifelse false {3} if 4 neg} bind def";
+	ps::Interpreter psi;
+	std::stringstream input(content);
+	EXPECT_TRUE(psi.Load(input));
+
+	auto run = [&psi]() {
+		psi.GetOperandStack().Clear();
+		auto count = psi.GetOperatorCount();
+		std::stringstream call("p");
+		EXPECT_TRUE(psi.Load(call));
+		return psi.GetOperatorCount() - count;
+	};
+
+	// 1 0 idiv fails, so it's left alone and raises undefinedresult
+	std::stringstream failing("{p} stopped");
+	EXPECT_TRUE(psi.Load(failing));
+	auto& stack = psi.GetOperandStack();
+	ASSERT_EQ(stack.Size(), 5);
+	EXPECT_EQ(stack[0].GetReal(), 72.0f / 300 * 2);
+	EXPECT_EQ(stack[3].GetOpcode(), ps::Opcode::IDiv);
+
+	std::stringstream fix("/p load 6 1 put");
+	EXPECT_TRUE(psi.Load(fix));
+	auto folded = run();
+	std::vector<float> expected = {72.0f / 300 * 2, 1, -4};
+	ASSERT_EQ(stack.Size(), expected.size());
+	EXPECT_EQ(stack[0].GetReal(), expected[0]);
+	EXPECT_EQ(stack[1].GetInteger(), 1);
+	EXPECT_EQ(stack[2].GetInteger(), -4);
+
+	auto p = *psi.DictLookup(ps::Value::Name(ps::NameTable::Intern("p")));
+	auto* code = p.GetObject<ps::ArrayObject>()->GetCode();
+	ASSERT_NE(code, nullptr);
+	EXPECT_EQ(code[0].op, ps::Bytecode::Inline);
+	EXPECT_EQ(code[0].span, 13) << "Everything up to the call of {1} should fold!";
+	EXPECT_EQ(code[13].op, ps::Bytecode::Inline);
+	EXPECT_EQ(code[13].span, 5) << "The dead branch and 4 neg should fold!";
+
+	// Names are guarded
+	std::stringstream shadow("clear /true false def p currentdict /true undef");
+	EXPECT_TRUE(psi.Load(shadow));
+	ASSERT_EQ(stack.Size(), 3);
+	EXPECT_EQ(stack[1].GetInteger(), 2);
+
+	// Without folding every operator runs
+	psi.SetConstantFolding(false);
+	std::stringstream recompile("/p load bind pop");
+	EXPECT_TRUE(psi.Load(recompile));
+	auto unfolded = run();
+	ASSERT_EQ(stack.Size(), expected.size());
+	EXPECT_EQ(stack[0].GetReal(), expected[0]);
+	EXPECT_EQ(stack[2].GetInteger(), -4);
+	EXPECT_LT(folded, unfolded);
+	EXPECT_EQ(folded, 1) << "Only exec should run!";
+	EXPECT_EQ(unfolded, 7);
+}
+
+TEST(Interpreter, Regions)
+{
+	std::stringstream input(
+		"/p {dup 2 mul exch 3 add 1 0 idiv 5} bind def "
+		"errordict /undefinedresult {pop pop pop 0} put 4 p");
+	ps::Interpreter psi;
+	EXPECT_TRUE(psi.Load(input));
+
+	auto& stack = psi.GetOperandStack();
+	std::vector<int> expected = {8, 7, 0, 5};
+	ASSERT_EQ(stack.Size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i)
+		EXPECT_EQ(stack[i].GetInteger(), expected[i]) << "Handlers should resume after the failed element, at " << i;
+
+	auto p = *psi.DictLookup(ps::Value::Name(ps::NameTable::Intern("p")));
+	auto* code = p.GetObject<ps::ArrayObject>()->GetCode();
+	ASSERT_NE(code, nullptr);
+	ASSERT_EQ(code[0].op, ps::Bytecode::Region);
+	EXPECT_EQ(code[0].span, 10);
+	EXPECT_EQ(code[0].region->depth, 1);
+	EXPECT_EQ(code[0].region->growth, 3);
+	EXPECT_TRUE(code[0].region->typeChecks[2]) << "mul's operand from below the region has any type!";
+	EXPECT_FALSE(code[0].region->typeChecks[8]) << "idiv's operands are known to be integers!";
+
+	// Without the operands the elements run one by one, type checks stay
+	std::stringstream underflow("clear {p} stopped");
+	EXPECT_TRUE(psi.Load(underflow));
+	ASSERT_EQ(stack.Size(), 2);
+	EXPECT_EQ(stack[0].GetOpcode(), ps::Opcode::Dup);
+
+	std::stringstream typecheck("clear /x {p} stopped");
+	EXPECT_TRUE(psi.Load(typecheck));
+	ASSERT_EQ(stack.Size(), 5);
+	EXPECT_EQ(stack[3].GetOpcode(), ps::Opcode::Mul);
+}